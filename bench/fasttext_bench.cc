@@ -0,0 +1,605 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Microbenchmarks of the training hot path.
+//
+// usage: fasttext-bench [-only kernels|update|dictionary|padding]
+//                       [-threads <n>] [-seconds <s>]
+//        fasttext-bench -corpus <file> <tokens> [<vocabulary>] [<seed>]
+//
+// The matrix benchmarks run at dims 50, 100, 300 and 1000 over 10k and
+// 100k rows, the dictionary ones over vocabularies of 10k, 100k and 1M
+// words. Rows, targets and words are drawn from the Zipf corpus of
+// zipfcorpus.h, so the frequent rows are hot as in training; -corpus
+// writes that corpus to a file instead. Each benchmark is repeated until
+// it ran -seconds and reports the time and the heap allocations per
+// operation. `padding` compares Model::update on -threads threads with
+// unpadded and cache-line padded matrices. The per-token update must not
+// touch the heap: the run fails if Model::update, Model::updateWindow or
+// NegativeSamplingLoss::forward allocate. `kernels` first runs every
+// kernel table the CPU supports against the scalar one on random inputs,
+// and fails if a float result is off by more than 1e-6 of the sum of the
+// absolute values of its terms, or an int8 product or a bf16/fp16
+// conversion is off at all.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/args.h"
+#include "../src/densematrix.h"
+#include "../src/dictionary.h"
+#include "../src/kernels.h"
+#include "../src/loss.h"
+#include "../src/model.h"
+#include "../src/rng.h"
+#include "../src/vector.h"
+#include "zipfcorpus.h"
+
+using namespace fasttext;
+
+namespace {
+
+std::atomic<int64_t> allocations(0);
+bool hotPathAllocates = false;
+bool kernelsDisagree = false;
+
+} // namespace
+
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+const int32_t DIMS[] = {50, 100, 300, 1000};
+const int32_t ROWS[] = {10000, 100000};
+const int32_t VOCABULARIES[] = {10000, 100000, 1000000};
+const int64_t CORPUS_TOKENS = 2000000;
+// operations whose inputs are drawn ahead, so drawing is not timed
+const int32_t SAMPLES = 1 << 16;
+// contexts of a -sharedNeg window, both sides of the default -ws 5
+const int32_t WINDOW = 10;
+// lengths for the kernel check, with tails past every vector width
+const int32_t CHECK_DIMS[] = {1, 3, 7, 8, 15, 16, 17, 31, 33, 50, 100, 301, 1000};
+// row blocks for the kernel check, up to a window by neg + 1 outputs
+const int32_t CHECK_BLOCKS[][2] = {{1, 1}, {3, 6}, {10, 11}};
+// The vectorized sums run in another order and with FMA, so each result
+// may differ from the scalar one by this much of the sum of the absolute
+// values of its terms. Integer products and conversions must be exact.
+const double KERNEL_TOLERANCE = 1e-6;
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct Options {
+  std::string only;
+  int32_t threads = std::thread::hardware_concurrency();
+  double seconds = 0.5;
+};
+
+// Exposes the hash table lookup, which getId wraps.
+class BenchDictionary : public Dictionary {
+ public:
+  explicit BenchDictionary(std::shared_ptr<Args> args) : Dictionary(args) {}
+  using Dictionary::find;
+};
+
+// run(n) does n operations; n grows until one call takes `target` seconds.
+// Returns the allocations per operation.
+template <typename F>
+double measure(
+    const char* name,
+    const std::string& dim,
+    int64_t words,
+    double target,
+    F run) {
+  run(1);
+  int64_t n = 1;
+  while (true) {
+    const int64_t before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    run(n);
+    const double elapsed = seconds(start);
+    if (elapsed >= target) {
+      const double allocs = double(allocations.load() - before) / n;
+      printf("%-30s %6s %8ld %12.1f %10.2f %10.3f\n", name, dim.c_str(),
+             long(words), elapsed * 1e9 / n, n / elapsed / 1e6, allocs);
+      fflush(stdout);
+      return allocs;
+    }
+    n = elapsed > 0 ? std::max(n * 2, int64_t(n * target / elapsed * 1.2))
+                    : n * 10;
+  }
+}
+
+void expectNoAllocations(const char* name, int32_t dim, double allocs) {
+  if (allocs > 0.0) {
+    std::cerr << name << " allocates at dim " << dim << std::endl;
+    hotPathAllocates = true;
+  }
+}
+
+std::vector<int32_t> zipfSamples(int32_t vocabulary, uint64_t seed) {
+  ZipfCorpus corpus(vocabulary, seed);
+  Rng rng(seed, 1);
+  std::vector<int32_t> samples(SAMPLES);
+  for (auto& s : samples) {
+    s = corpus.sample(rng);
+  }
+  return samples;
+}
+
+std::vector<int64_t> zipfCounts(int32_t vocabulary) {
+  std::vector<int64_t> counts(vocabulary);
+  for (int32_t i = 0; i < vocabulary; i++) {
+    counts[i] = 100000000 / (i + 1) + 1;
+  }
+  return counts;
+}
+
+std::shared_ptr<DenseMatrix> randomMatrix(int64_t m, int64_t n, bool padded) {
+  auto matrix =
+      std::make_shared<DenseMatrix>(m, n, numa_policy::none, padded);
+  matrix->uniform(1.0 / n, 1, 0);
+  return matrix;
+}
+
+real uniformReal(Rng& rng) {
+  return real(rng.next32() / 4294967296.0 * 2.0 - 1.0);
+}
+
+// Compares one result of `table` with the scalar one; `magnitude` is the
+// sum of the absolute values of the terms, 0 for exact results.
+void expectAgreement(
+    const std::string& table,
+    const char* kernel,
+    int32_t n,
+    double got,
+    double want,
+    double magnitude) {
+  const bool bothNan = std::isnan(got) && std::isnan(want);
+  if (!bothNan && !(std::abs(got - want) <= KERNEL_TOLERANCE * magnitude)) {
+    std::cerr << table << " " << kernel << " differs from scalar at n " << n
+              << ": " << got << " instead of " << want << std::endl;
+    kernelsDisagree = true;
+  }
+}
+
+// Runs every kernel table this CPU supports on random inputs and checks
+// it against the scalar table.
+void checkKernels() {
+  const kernels::KernelTable& ref = kernels::scalar();
+  const std::string active = kernels::get().name;
+  Rng rng(5);
+  for (const std::string& name : kernels::available()) {
+    kernels::select(name);
+    const kernels::KernelTable& k = kernels::get();
+    for (int32_t n : CHECK_DIMS) {
+      std::vector<real> x(n), y(n), y1(n), y2(n);
+      std::vector<int8_t> qx(n), qy(n);
+      std::vector<uint16_t> h(n), h1(n), h2(n);
+      std::vector<real> f1(n), f2(n);
+      for (int32_t i = 0; i < n; i++) {
+        x[i] = uniformReal(rng);
+        y[i] = uniformReal(rng);
+        qx[i] = int8_t(rng.next32());
+        qy[i] = int8_t(rng.next32());
+        h[i] = uint16_t(rng.next32());
+      }
+      double dotMagnitude = 0.0, sqMagnitude = 0.0;
+      for (int32_t i = 0; i < n; i++) {
+        dotMagnitude += std::abs(double(x[i]) * y[i]);
+        sqMagnitude += double(x[i]) * x[i];
+      }
+      expectAgreement(name, "dot", n, k.dot(x.data(), y.data(), n),
+                      ref.dot(x.data(), y.data(), n), dotMagnitude);
+      expectAgreement(name, "sqnorm", n, k.sqnorm(x.data(), n),
+                      ref.sqnorm(x.data(), n), sqMagnitude);
+      expectAgreement(name, "dotInt8", n, k.dotInt8(qx.data(), qy.data(), n),
+                      ref.dotInt8(qx.data(), qy.data(), n), 0.0);
+
+      const real a = uniformReal(rng);
+      y1 = y;
+      y2 = y;
+      k.axpy(a, x.data(), y1.data(), n);
+      ref.axpy(a, x.data(), y2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "axpy", n, y1[i], y2[i],
+                        std::abs(double(a) * x[i]) + std::abs(y[i]));
+      }
+      y1 = y;
+      y2 = y;
+      k.scale(a, y1.data(), n);
+      ref.scale(a, y2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "scale", n, y1[i], y2[i],
+                        std::abs(double(a) * y[i]));
+      }
+
+      // random bit patterns, NaNs included, and floats from fp16
+      // subnormals to past its range
+      k.bf16ToFloat(h.data(), f1.data(), n);
+      ref.bf16ToFloat(h.data(), f2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "bf16ToFloat", n, f1[i], f2[i], 0.0);
+      }
+      k.fp16ToFloat(h.data(), f1.data(), n);
+      ref.fp16ToFloat(h.data(), f2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "fp16ToFloat", n, f1[i], f2[i], 0.0);
+      }
+      for (int32_t i = 0; i < n; i++) {
+        f1[i] = std::ldexp(uniformReal(rng), int(rng.uniform(48)) - 30);
+      }
+      k.floatToBf16(f1.data(), h1.data(), n);
+      ref.floatToBf16(f1.data(), h2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "floatToBf16", n, h1[i], h2[i], 0.0);
+      }
+      k.floatToFp16(f1.data(), h1.data(), n);
+      ref.floatToFp16(f1.data(), h2.data(), n);
+      for (int32_t i = 0; i < n; i++) {
+        expectAgreement(name, "floatToFp16", n, h1[i], h2[i], 0.0);
+      }
+
+      for (const auto& block : CHECK_BLOCKS) {
+        const int32_t m = block[0], p = block[1];
+        std::vector<std::vector<real>> rx(m, std::vector<real>(n));
+        std::vector<std::vector<real>> ry(p, std::vector<real>(n));
+        std::vector<const real*> px(m), py(p);
+        for (int32_t i = 0; i < m; i++) {
+          for (auto& v : rx[i]) {
+            v = uniformReal(rng);
+          }
+          px[i] = rx[i].data();
+        }
+        for (int32_t j = 0; j < p; j++) {
+          for (auto& v : ry[j]) {
+            v = uniformReal(rng);
+          }
+          py[j] = ry[j].data();
+        }
+        std::vector<real> c1(m * p), c2(m * p);
+        k.dotBlock(px.data(), m, py.data(), p, n, c1.data());
+        ref.dotBlock(px.data(), m, py.data(), p, n, c2.data());
+        for (int32_t i = 0; i < m; i++) {
+          for (int32_t j = 0; j < p; j++) {
+            double magnitude = 0.0;
+            for (int32_t l = 0; l < n; l++) {
+              magnitude += std::abs(double(rx[i][l]) * ry[j][l]);
+            }
+            expectAgreement(name, "dotBlock", n, c1[i * p + j], c2[i * p + j],
+                            magnitude);
+          }
+        }
+
+        // y[i] += sum_j c[i * p + j] * ry[j], for i < m
+        std::vector<std::vector<real>> out1(rx), out2(rx);
+        std::vector<real*> po1(m), po2(m);
+        for (int32_t i = 0; i < m; i++) {
+          po1[i] = out1[i].data();
+          po2[i] = out2[i].data();
+        }
+        k.axpyBlock(c2.data(), py.data(), p, po1.data(), m, n);
+        ref.axpyBlock(c2.data(), py.data(), p, po2.data(), m, n);
+        for (int32_t i = 0; i < m; i++) {
+          for (int32_t l = 0; l < n; l++) {
+            double magnitude = std::abs(rx[i][l]);
+            for (int32_t j = 0; j < p; j++) {
+              magnitude += std::abs(double(c2[i * p + j]) * ry[j][l]);
+            }
+            expectAgreement(name, "axpyBlock", n, out1[i][l], out2[i][l],
+                            magnitude);
+          }
+        }
+      }
+    }
+  }
+  kernels::select(active);
+}
+
+void benchKernels(const Options& options) {
+  checkKernels();
+  for (int32_t rows : ROWS) {
+    const std::vector<int32_t> ids = zipfSamples(rows, 1);
+    for (int32_t dim : DIMS) {
+      auto matrix = randomMatrix(rows, dim, false);
+      Vector vec(dim);
+      for (int32_t j = 0; j < dim; j++) {
+        vec[j] = 1.0 / (j + 1);
+      }
+      const std::string d = std::to_string(dim);
+      volatile real sink = 0.0;
+      measure("DenseMatrix::dotRow", d, rows, options.seconds, [&](int64_t n) {
+        real sum = 0.0;
+        for (int64_t i = 0; i < n; i++) {
+          sum += matrix->dotRow(vec, ids[i % SAMPLES]);
+        }
+        sink = sum;
+      });
+      measure("DenseMatrix::addVectorToRow", d, rows, options.seconds, [&](int64_t n) {
+        for (int64_t i = 0; i < n; i++) {
+          matrix->addVectorToRow(vec, ids[i % SAMPLES], 1e-6);
+        }
+      });
+      measure("DenseMatrix::addRowToVector", d, rows, options.seconds, [&](int64_t n) {
+        for (int64_t i = 0; i < n; i++) {
+          matrix->addRowToVector(vec, ids[i % SAMPLES], 1e-6);
+        }
+      });
+      measure("DenseMatrix::l2NormRow", d, rows, options.seconds, [&](int64_t n) {
+        real sum = 0.0;
+        for (int64_t i = 0; i < n; i++) {
+          sum += matrix->l2NormRow(ids[i % SAMPLES]);
+        }
+        sink = sum;
+      });
+      (void)sink;
+    }
+  }
+}
+
+void benchUpdate(const Options& options) {
+  for (int32_t rows : ROWS) {
+    const std::vector<int32_t> inputs = zipfSamples(rows, 2);
+    const std::vector<int32_t> targets = zipfSamples(rows, 3);
+    for (int32_t dim : DIMS) {
+      std::shared_ptr<Matrix> wi = randomMatrix(rows, dim, false);
+      std::shared_ptr<Matrix> wo = randomMatrix(rows, dim, false);
+      auto loss =
+          std::make_shared<NegativeSamplingLoss>(wo, 5, 0.5, zipfCounts(rows));
+      Model model(wi, wo, loss, false);
+      Model::State state(dim, 0, 1);
+      // {input, target}; the input is the secTarget, as in FastText::skipgram
+      std::vector<int32_t> line(2);
+      double allocs = measure(
+          "Model::update", std::to_string(dim), rows, options.seconds,
+          [&](int64_t n) {
+            for (int64_t i = 0; i < n; i++) {
+              line[0] = inputs[i % SAMPLES];
+              line[1] = targets[i % SAMPLES];
+              model.update(line[0], line, 1, 0, 0.01, state);
+            }
+          });
+      expectNoAllocations("Model::update", dim, allocs);
+      std::vector<int32_t> window(WINDOW);
+      allocs = measure(
+          "Model::updateWindow", std::to_string(dim), rows, options.seconds,
+          [&](int64_t n) {
+            for (int64_t i = 0; i < n; i++) {
+              for (int32_t c = 0; c < WINDOW; c++) {
+                window[c] = inputs[(i * WINDOW + c) % SAMPLES];
+              }
+              model.updateWindow(window, targets[i % SAMPLES], 0.01, state);
+            }
+          });
+      expectNoAllocations("Model::updateWindow", dim, allocs);
+
+      Vector hidden(dim);
+      for (int32_t j = 0; j < dim; j++) {
+        hidden[j] = 1.0 / (j + 1);
+      }
+      hidden.mul(1.0 / hidden.norm());
+      allocs = measure(
+          "NegativeSamplingLoss::forward", std::to_string(dim), rows, options.seconds,
+          [&](int64_t n) {
+            for (int64_t i = 0; i < n; i++) {
+              line[0] = inputs[i % SAMPLES];
+              line[1] = targets[i % SAMPLES];
+              state.inputVec = hidden;
+              state.inputGrad.zero();
+              loss->forward(line, 1, 0, state, 0.01, true);
+            }
+          });
+      expectNoAllocations("NegativeSamplingLoss::forward", dim, allocs);
+    }
+  }
+}
+
+// Model::update on several threads sharing the matrices, whose low rows
+// all of them write.
+double updateRate(
+    int32_t dim,
+    bool padded,
+    int32_t nthreads,
+    int64_t updates,
+    int32_t rows) {
+  std::shared_ptr<Matrix> wi = randomMatrix(rows, dim, padded);
+  std::shared_ptr<Matrix> wo = randomMatrix(rows, dim, padded);
+  auto loss =
+      std::make_shared<NegativeSamplingLoss>(wo, 5, 0.5, zipfCounts(rows));
+  Model model(wi, wo, loss, false);
+  const ZipfCorpus corpus(rows);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < nthreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      Model::State state(dim, t, 1);
+      Rng rng(2, t);
+      std::vector<int32_t> line(2);
+      for (int64_t i = 0; i < updates; i++) {
+        line[0] = corpus.sample(rng);
+        line[1] = corpus.sample(rng);
+        model.update(line[0], line, 1, 0, 0.01, state);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return nthreads * updates / seconds(start);
+}
+
+void benchPadding(const Options& options) {
+  const int32_t rows = 100000;
+  printf("\nModel::update, %d threads, %d rows\n", options.threads, rows);
+  printf("%6s %8s %14s %14s %8s\n", "dim", "stride", "unpadded/s",
+         "padded/s", "speedup");
+  for (int32_t dim : DIMS) {
+    // about -seconds per run at the single thread rate of dim 100
+    const int64_t updates = int64_t(options.seconds * 4e5 * 100 / dim) + 1;
+    double plain = updateRate(dim, false, options.threads, updates, rows);
+    double padded = updateRate(dim, true, options.threads, updates, rows);
+    printf("%6d %8ld %14.0f %14.0f %8.3f\n", dim,
+           long(DenseMatrix::paddedStride(dim)), plain, padded,
+           padded / plain);
+  }
+}
+
+void benchDictionary(const Options& options) {
+  for (int32_t vocabulary : VOCABULARIES) {
+    const std::string text = ZipfCorpus(vocabulary).text(CORPUS_TOKENS);
+    auto args = std::make_shared<Args>();
+    args->minCount = 1;
+    args->verbose = 0;
+    BenchDictionary dict(args);
+    std::istringstream in(text);
+    dict.readFromFile(in);
+
+    in.clear();
+    in.seekg(0);
+    std::string word;
+    measure("Dictionary::readWord", "-", vocabulary, options.seconds,
+            [&](int64_t n) {
+              for (int64_t i = 0; i < n; i++) {
+                if (!dict.readWord(in, word)) {
+                  in.clear();
+                  in.seekg(0);
+                }
+              }
+            });
+
+    // per line; the corpus averages (MIN_LINE + MAX_LINE) / 2 words + EOS
+    in.clear();
+    in.seekg(0);
+    Rng rng(4);
+    std::vector<int32_t> line;
+    measure("Dictionary::getLine", "-", vocabulary, options.seconds,
+            [&](int64_t n) {
+              for (int64_t i = 0; i < n; i++) {
+                dict.getLine(in, line, rng);
+              }
+            });
+
+    const std::vector<int32_t> ranks = zipfSamples(vocabulary, 5);
+    std::vector<std::string> queries(SAMPLES);
+    for (int32_t i = 0; i < SAMPLES; i++) {
+      queries[i] = ZipfCorpus::word(ranks[i]);
+    }
+    volatile int32_t sink = 0;
+    measure("Dictionary::find", "-", vocabulary, options.seconds,
+            [&](int64_t n) {
+              int32_t sum = 0;
+              for (int64_t i = 0; i < n; i++) {
+                sum += dict.find(queries[i % SAMPLES]);
+              }
+              sink = sum;
+            });
+    (void)sink;
+  }
+}
+
+void writeCorpus(int argc, char** argv) {
+  if (argc < 4) {
+    std::cerr << "usage: fasttext-bench -corpus <file> <tokens> "
+                 "[<vocabulary>] [<seed>]"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  const int64_t tokens = std::stoll(argv[3]);
+  const int32_t vocabulary = argc > 4 ? std::stoi(argv[4]) : 100000;
+  const uint64_t seed = argc > 5 ? std::stoull(argv[5]) : 1;
+  std::ofstream out(argv[2]);
+  if (!out.is_open()) {
+    std::cerr << argv[2] << " cannot be opened for writing!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  ZipfCorpus(vocabulary, seed).write(out, tokens);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "-corpus") {
+    writeCorpus(argc, argv);
+    return 0;
+  }
+  Options options;
+  for (int ai = 1; ai + 1 < argc; ai += 2) {
+    const std::string arg = argv[ai];
+    if (arg == "-only") {
+      options.only = argv[ai + 1];
+    } else if (arg == "-threads") {
+      options.threads = std::stoi(argv[ai + 1]);
+    } else if (arg == "-seconds") {
+      options.seconds = std::stod(argv[ai + 1]);
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 1;
+    }
+  }
+  auto selected = [&](const char* name) {
+    return options.only.empty() || options.only == name;
+  };
+
+  printf("%-30s %6s %8s %12s %10s %10s\n", "benchmark", "dim", "words",
+         "ns/op", "Mop/s", "allocs/op");
+  if (selected("kernels")) {
+    benchKernels(options);
+  }
+  if (selected("update")) {
+    benchUpdate(options);
+  }
+  if (selected("dictionary")) {
+    benchDictionary(options);
+  }
+  if (selected("padding")) {
+    benchPadding(options);
+  }
+  return hotPathAllocates || kernelsDisagree ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Recall versus latency of the HNSW index against exact search.
+//
+// usage: fasttext-hnsw-bench <model> [<queries>] [<k>] [<M>] [<efConstruction>]
+//
+// Query words are sampled uniformly from the vocabulary. Exact neighbours
+// come from NearestNeighbors; every HNSW query runs on one thread so the
+// latencies are per query.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../src/fasttext.h"
+#include "../src/hnsw.h"
+#include "../src/neighbors.h"
+
+using namespace fasttext;
+
+namespace {
+
+double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+double percentile(std::vector<double> v, double p) {
+  std::sort(v.begin(), v.end());
+  return v[std::min<size_t>(v.size() - 1, size_t(p * v.size()))];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: fasttext-hnsw-bench <model> [<queries>] [<k>] [<M>] "
+                 "[<efConstruction>]"
+              << std::endl;
+    return 1;
+  }
+  const int32_t nqueries = argc > 2 ? std::stoi(argv[2]) : 1000;
+  const int32_t k = argc > 3 ? std::stoi(argv[3]) : 10;
+  const int32_t M = argc > 4 ? std::stoi(argv[4]) : 16;
+  const int32_t efConstruction = argc > 5 ? std::stoi(argv[5]) : 200;
+
+  FastText fasttext;
+  fasttext.loadModel(argv[1]);
+  const int32_t nthreads = fasttext.getArgs()->thread;
+  std::shared_ptr<const DenseMatrix> input =
+      std::dynamic_pointer_cast<const DenseMatrix>(fasttext.getInputMatrix());
+  const int64_t m = input->rows(), n = input->cols();
+
+  std::minstd_rand rng(1);
+  std::uniform_int_distribution<int64_t> pick(0, m - 1);
+  DenseMatrix queries(nqueries, n);
+  std::vector<std::vector<int32_t>> exclude(nqueries);
+  for (int32_t q = 0; q < nqueries; q++) {
+    int32_t id = pick(rng);
+    std::copy(input->row(id), input->row(id) + n, queries.row(q));
+    exclude[q].push_back(id);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  NearestNeighbors exact(input, nthreads);
+  std::vector<std::vector<NearestNeighbors::Neighbor>> truth =
+      exact.search(queries, k, exclude);
+  double exactTime = seconds(start);
+
+  start = std::chrono::steady_clock::now();
+  Hnsw index(input, M, efConstruction);
+  index.build(nthreads, 0);
+  double buildTime = seconds(start);
+
+  printf("rows %ld  dim %ld  queries %d  k %d  threads %d\n",
+         m, n, nqueries, k, nthreads);
+  printf("exact: %.3f ms/query (batched, %d threads)\n",
+         1e3 * exactTime / nqueries, nthreads);
+  printf("hnsw build: M %d  efConstruction %d  %.2f s\n\n",
+         M, efConstruction, buildTime);
+  printf("%8s %10s %12s %12s %12s\n", "ef", "recall", "mean(us)", "p50(us)", "p99(us)");
+
+  Hnsw::Scratch scratch;
+  for (int32_t ef : {10, 20, 40, 80, 160, 320, 640}) {
+    if (ef < k) {
+      continue;
+    }
+    std::vector<double> latencies(nqueries);
+    int64_t hits = 0, total = 0;
+    for (int32_t q = 0; q < nqueries; q++) {
+      auto t = std::chrono::steady_clock::now();
+      std::vector<Hnsw::Neighbor> found =
+          index.search(queries.row(q), k, ef, scratch, exclude[q][0]);
+      latencies[q] = 1e6 * seconds(t);
+      std::set<int32_t> ids;
+      for (const auto& neighbor : found) {
+        ids.insert(neighbor.second);
+      }
+      for (const auto& neighbor : truth[q]) {
+        hits += ids.count(neighbor.second);
+      }
+      total += truth[q].size();
+    }
+    double mean = 0;
+    for (double l : latencies) {
+      mean += l;
+    }
+    printf("%8d %10.4f %12.1f %12.1f %12.1f\n",
+           ef,
+           total ? double(hits) / total : 0.0,
+           mean / nqueries,
+           percentile(latencies, 0.5),
+           percentile(latencies, 0.99));
+  }
+  return 0;
+}
@@ -0,0 +1,407 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// End-to-end FastText::train over a sweep of thread counts and dims.
+//
+// usage: fasttext-train-bench [-input <file>] [-tokens <n>]
+//                             [-vocabulary <n>] [-threads <list>]
+//                             [-dims <list>] [-epoch <n>] [-repeat <n>]
+//                             [-json <file>]
+//
+// Without -input the corpus is generated by ZipfCorpus (zipfcorpus.h), so
+// runs on different hosts train on the same text. Every configuration
+// trains in a forked child, which gives it a fresh heap and its own peak
+// RSS (from wait4), and counts cycles, instructions, LLC and dTLB load
+// misses of all its threads with perf_event_open; counters the kernel
+// refuses (perf_event_paranoid, containers) are reported as null. With
+// -repeat, the fastest run of each configuration is kept. The results go
+// to -json (stdout by default) together with the scaling efficiency of
+// each dim relative to its smallest thread count, which is also printed
+// as a table on stderr. tokens/s counts epoch * ntokens over the whole of
+// train(), dictionary included.
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/args.h"
+#include "../src/fasttext.h"
+#include "../src/real.h"
+#include "zipfcorpus.h"
+
+using namespace fasttext;
+
+namespace {
+
+struct Counter {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
+
+const uint64_t CACHE_READ_MISS = (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) |
+    (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+
+const Counter COUNTERS[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"llcMisses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | CACHE_READ_MISS},
+    {"dtlbMisses",
+     PERF_TYPE_HW_CACHE,
+     PERF_COUNT_HW_CACHE_DTLB | CACHE_READ_MISS},
+};
+const int32_t NCOUNTERS = sizeof(COUNTERS) / sizeof(COUNTERS[0]);
+
+struct Options {
+  std::string input;
+  int64_t tokens = 10000000;
+  int32_t vocabulary = 100000;
+  std::vector<int32_t> threads = {1, 2, 4, 8};
+  std::vector<int32_t> dims = {50, 100, 300};
+  int32_t epoch = 1;
+  int32_t repeat = 1;
+  std::string json;
+};
+
+// What a child sends back through its pipe.
+struct Measurement {
+  double seconds = 0.0;
+  int64_t tokens = 0;
+  double counters[NCOUNTERS] = {};
+  bool counted[NCOUNTERS] = {};
+};
+
+struct Run {
+  int32_t threads;
+  int32_t dim;
+  bool ok;
+  Measurement measurement;
+  int64_t peakRssKb;
+};
+
+std::vector<int32_t> parseList(const std::string& list) {
+  std::vector<int32_t> values;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    values.push_back(std::stoi(item));
+  }
+  return values;
+}
+
+// Counts this process and the threads it starts from now on, in user
+// space only so that it works with perf_event_paranoid 2; -1 if refused.
+int openCounter(const Counter& counter) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = counter.type;
+  attr.config = counter.config;
+  attr.disabled = 1;
+  attr.inherit = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Scaled up when the counter was multiplexed with others.
+bool readCounter(int fd, double& value) {
+  uint64_t data[3];
+  if (read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+    return false;
+  }
+  value = double(data[0]) * double(data[1]) / double(data[2]);
+  return true;
+}
+
+Measurement train(const Options& options, int32_t threads, int32_t dim) {
+  Args args;
+  args.input = options.input;
+  args.output = "/dev/null";
+  args.thread = threads;
+  args.dim = dim;
+  args.epoch = options.epoch;
+  args.verbose = 0;
+
+  int fds[NCOUNTERS];
+  for (int32_t i = 0; i < NCOUNTERS; i++) {
+    fds[i] = openCounter(COUNTERS[i]);
+  }
+  for (int fd : fds) {
+    if (fd >= 0) {
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+  FastText fasttext;
+  auto start = std::chrono::steady_clock::now();
+  fasttext.train(args);
+  Measurement m;
+  m.seconds = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  for (int32_t i = 0; i < NCOUNTERS; i++) {
+    if (fds[i] >= 0) {
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      m.counted[i] = readCounter(fds[i], m.counters[i]);
+      close(fds[i]);
+    }
+  }
+  m.tokens = int64_t(options.epoch) * fasttext.getDictionary()->ntokens();
+  return m;
+}
+
+Run runChild(const Options& options, int32_t threads, int32_t dim) {
+  Run run = {threads, dim, false, Measurement(), 0};
+  int pipefd[2];
+  if (pipe(pipefd) != 0) {
+    return run;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(pipefd[0]);
+    bool ok = false;
+    try {
+      Measurement m = train(options, threads, dim);
+      ok = write(pipefd[1], &m, sizeof(m)) == sizeof(m);
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+    _exit(ok ? 0 : 1);
+  }
+  close(pipefd[1]);
+  if (pid < 0) {
+    close(pipefd[0]);
+    return run;
+  }
+  const bool received =
+      read(pipefd[0], &run.measurement, sizeof(Measurement)) ==
+      sizeof(Measurement);
+  close(pipefd[0]);
+  int status = 0;
+  rusage usage;
+  std::memset(&usage, 0, sizeof(usage));
+  while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {
+  }
+  run.ok = received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  run.peakRssKb = usage.ru_maxrss;
+  return run;
+}
+
+double tokensPerSecond(const Run& run) {
+  return run.measurement.tokens / run.measurement.seconds;
+}
+
+// Throughput per thread relative to the smallest thread count of the dim.
+double efficiency(const std::vector<Run>& runs, const Run& run) {
+  const Run* base = nullptr;
+  for (const Run& r : runs) {
+    if (r.ok && r.dim == run.dim && (!base || r.threads < base->threads)) {
+      base = &r;
+    }
+  }
+  if (!base || !run.ok) {
+    return 0.0;
+  }
+  return tokensPerSecond(run) / run.threads /
+      (tokensPerSecond(*base) / base->threads);
+}
+
+std::string jsonString(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (uint8_t(c) < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      out += buffer;
+    } else {
+      out.push_back(c);
+    }
+  }
+  return out + "\"";
+}
+
+void writeJson(
+    std::ostream& out,
+    const Options& options,
+    bool generated,
+    const std::vector<Run>& runs) {
+  utsname host;
+  std::memset(&host, 0, sizeof(host));
+  uname(&host);
+  out.precision(6);
+  out << "{\n";
+  out << "  \"host\": {\"name\": " << jsonString(host.nodename)
+      << ", \"kernel\": " << jsonString(host.release)
+      << ", \"machine\": " << jsonString(host.machine)
+      << ", \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "},\n";
+  out << "  \"build\": {\"compiler\": " << jsonString(__VERSION__)
+      << ", \"realBytes\": " << sizeof(real) << "},\n";
+  out << "  \"corpus\": {\"input\": "
+      << (generated ? "null" : jsonString(options.input))
+      << ", \"generated\": " << (generated ? "true" : "false");
+  if (generated) {
+    out << ", \"tokens\": " << options.tokens
+        << ", \"vocabulary\": " << options.vocabulary;
+  }
+  out << "},\n";
+  out << "  \"epoch\": " << options.epoch << ",\n";
+  out << "  \"repeat\": " << options.repeat << ",\n";
+  out << "  \"runs\": [";
+  for (size_t i = 0; i < runs.size(); i++) {
+    const Run& run = runs[i];
+    const Measurement& m = run.measurement;
+    out << (i > 0 ? ",\n" : "\n") << "    {\"threads\": " << run.threads
+        << ", \"dim\": " << run.dim << ", \"ok\": "
+        << (run.ok ? "true" : "false");
+    if (run.ok) {
+      out << std::fixed << ", \"seconds\": " << m.seconds
+          << ", \"tokens\": " << m.tokens
+          << ", \"tokensPerSecond\": " << tokensPerSecond(run)
+          << ", \"scalingEfficiency\": " << efficiency(runs, run)
+          << ", \"peakRssKb\": " << run.peakRssKb;
+      for (int32_t c = 0; c < NCOUNTERS; c++) {
+        out << ", \"" << COUNTERS[c].name << "\": ";
+        if (m.counted[c]) {
+          out << std::setprecision(0) << m.counters[c];
+        } else {
+          out << "null";
+        }
+      }
+      out << std::setprecision(6) << ", \"ipc\": ";
+      if (m.counted[0] && m.counted[1] && m.counters[0] > 0) {
+        out << m.counters[1] / m.counters[0];
+      } else {
+        out << "null";
+      }
+      out << std::defaultfloat;
+    }
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+}
+
+void printTable(const std::vector<Run>& runs) {
+  fprintf(stderr, "%6s %8s %10s %14s %11s %10s %8s\n", "dim", "threads",
+          "seconds", "tokens/s", "efficiency", "rss MB", "ipc");
+  for (const Run& run : runs) {
+    if (!run.ok) {
+      fprintf(stderr, "%6d %8d %10s\n", run.dim, run.threads, "failed");
+      continue;
+    }
+    const Measurement& m = run.measurement;
+    const bool ipc = m.counted[0] && m.counted[1] && m.counters[0] > 0;
+    fprintf(stderr, "%6d %8d %10.2f %14.0f %11.3f %10.1f %8s\n", run.dim,
+            run.threads, m.seconds, tokensPerSecond(run),
+            efficiency(runs, run), run.peakRssKb / 1024.0,
+            ipc ? std::to_string(m.counters[1] / m.counters[0])
+                      .substr(0, 5)
+                      .c_str()
+                : "-");
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int ai = 1; ai + 1 < argc; ai += 2) {
+    const std::string arg = argv[ai];
+    if (arg == "-input") {
+      options.input = argv[ai + 1];
+    } else if (arg == "-tokens") {
+      options.tokens = std::stoll(argv[ai + 1]);
+    } else if (arg == "-vocabulary") {
+      options.vocabulary = std::stoi(argv[ai + 1]);
+    } else if (arg == "-threads") {
+      options.threads = parseList(argv[ai + 1]);
+    } else if (arg == "-dims") {
+      options.dims = parseList(argv[ai + 1]);
+    } else if (arg == "-epoch") {
+      options.epoch = std::stoi(argv[ai + 1]);
+    } else if (arg == "-repeat") {
+      options.repeat = std::max(1, std::stoi(argv[ai + 1]));
+    } else if (arg == "-json") {
+      options.json = argv[ai + 1];
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  const bool generated = options.input.empty();
+  if (generated) {
+    char path[] = "/tmp/fasttext-train-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+      std::cerr << "Cannot create a temporary corpus file" << std::endl;
+      return 1;
+    }
+    close(fd);
+    options.input = path;
+    std::ofstream out(options.input);
+    ZipfCorpus(options.vocabulary).write(out, options.tokens);
+    if (!out) {
+      std::cerr << options.input << " cannot be written!" << std::endl;
+      unlink(path);
+      return 1;
+    }
+  }
+
+  std::vector<Run> runs;
+  for (int32_t dim : options.dims) {
+    for (int32_t threads : options.threads) {
+      Run best = runChild(options, threads, dim);
+      for (int32_t r = 1; r < options.repeat; r++) {
+        Run run = runChild(options, threads, dim);
+        if (run.ok && (!best.ok || run.measurement.seconds <
+                                       best.measurement.seconds)) {
+          best = run;
+        }
+      }
+      runs.push_back(best);
+    }
+  }
+  if (generated) {
+    unlink(options.input.c_str());
+  }
+
+  printTable(runs);
+  if (options.json.empty()) {
+    writeJson(std::cout, options, generated, runs);
+  } else {
+    std::ofstream out(options.json);
+    writeJson(out, options, generated, runs);
+    if (!out) {
+      std::cerr << options.json << " cannot be written!" << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/rng.h"
+
+namespace fasttext {
+
+// Deterministic synthetic text for the benchmarks. Word ranks follow a
+// Zipf distribution, P(i) ~ 1 / (i + 1)^exponent, over a fixed vocabulary,
+// and line lengths are uniform in [MIN_LINE, MAX_LINE]. The word of rank i
+// is the bijective base-26 spelling of i + 1 ("a" .. "z", "aa", ...), so
+// frequent words are short, as in natural text. Everything is drawn from
+// Rng, so a seed gives the same text on any machine.
+class ZipfCorpus {
+ public:
+  static const int32_t MIN_LINE = 5;
+  static const int32_t MAX_LINE = 30;
+
+  explicit ZipfCorpus(
+      int32_t vocabulary,
+      uint64_t seed = 1,
+      double exponent = 1.0)
+      : cdf_(vocabulary), seed_(seed) {
+    double z = 0.0;
+    for (int32_t i = 0; i < vocabulary; i++) {
+      z += exponent == 1.0 ? 1.0 / (i + 1) : std::pow(i + 1.0, -exponent);
+      cdf_[i] = z;
+    }
+    for (auto& c : cdf_) {
+      c /= z;
+    }
+  }
+
+  int32_t vocabulary() const {
+    return cdf_.size();
+  }
+
+  int32_t sample(Rng& rng) const {
+    const double u = double(rng() >> 11) / double(uint64_t(1) << 53);
+    return std::min<int32_t>(
+        cdf_.size() - 1,
+        std::lower_bound(cdf_.begin(), cdf_.end(), u) - cdf_.begin());
+  }
+
+  static std::string word(int32_t rank) {
+    std::string w;
+    for (int64_t i = int64_t(rank) + 1; i > 0; i = (i - 1) / 26) {
+      w.push_back(char('a' + (i - 1) % 26));
+    }
+    std::reverse(w.begin(), w.end());
+    return w;
+  }
+
+  // `tokens` words in whole lines (the last one may be shorter)
+  void write(std::ostream& out, int64_t tokens) const {
+    Rng rng(seed_);
+    std::vector<std::string> words(vocabulary());
+    for (int32_t i = 0; i < vocabulary(); i++) {
+      words[i] = word(i);
+    }
+    std::string line;
+    while (tokens > 0) {
+      int64_t length = MIN_LINE + rng.uniform(MAX_LINE - MIN_LINE + 1);
+      length = std::min(length, tokens);
+      line.clear();
+      for (int64_t j = 0; j < length; j++) {
+        if (j > 0) {
+          line.push_back(' ');
+        }
+        line += words[sample(rng)];
+      }
+      line.push_back('\n');
+      out << line;
+      tokens -= length;
+    }
+  }
+
+  std::string text(int64_t tokens) const {
+    std::ostringstream out;
+    write(out, tokens);
+    return out.str();
+  }
+
+ private:
+  std::vector<double> cdf_;
+  uint64_t seed_;
+};
+
+} // namespace fasttext
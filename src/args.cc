@@ -23,7 +23,14 @@ Args::Args() {
   epoch = 5;
   minCount = 5;
   minCountLabel = 0;
+  vocabBudget = 0;
+  warmup = 10000000;
+  tokenBudget = 0;
   neg = 5;
+  negPower = 0.5;
+  sharedNeg = false;
+  hotRows = 0;
+  hotSync = 256;
   wordNgrams = 1;
   loss = loss_name::ns;
   model = model_name::sg;
@@ -31,12 +38,29 @@ Args::Args() {
   minn = 3;
   maxn = 6;
   thread = 12;
+  numa = numa_policy::none;
+  pin = pin_policy::none;
+  padRows = false;
+  precision = precision_name::fp32;
+  fullRows = 0;
   lrUpdateRate = 100;
   t = 1e-4;
   label = "__label__";
   verbose = 2;
   pretrainedVectors = "";
+  cache = "";
+  cacheVarint = false;
   saveOutput = false;
+  exportShards = 1;
+  checkpoint = 0;
+  resume = false;
+  workers = 1;
+  rank = 0;
+  master = "";
+  syncTokens = 1000000;
+  syncTopK = 0;
+  syncFp16 = false;
+  shm = "";
   seed = 0;
 
   qout = false;
@@ -96,6 +120,42 @@ std::string Args::metricToString(metric_name mn) const {
   return "Unknown metric name!"; // should never happen
 }
 
+std::string Args::numaToString(numa_policy np) const {
+  switch (np) {
+    case numa_policy::none:
+      return "none";
+    case numa_policy::interleave:
+      return "interleave";
+    case numa_policy::local:
+      return "local";
+  }
+  return "Unknown numa policy!"; // should never happen
+}
+
+std::string Args::pinToString(pin_policy pp) const {
+  switch (pp) {
+    case pin_policy::none:
+      return "none";
+    case pin_policy::compact:
+      return "compact";
+    case pin_policy::scatter:
+      return "scatter";
+  }
+  return "Unknown pin policy!"; // should never happen
+}
+
+std::string Args::precisionToString(precision_name pn) const {
+  switch (pn) {
+    case precision_name::fp32:
+      return "fp32";
+    case precision_name::bf16:
+      return "bf16";
+    case precision_name::fp16:
+      return "fp16";
+  }
+  return "Unknown precision!"; // should never happen
+}
+
 void Args::parseArgs(const std::vector<std::string>& args) {
   std::string command(args[1]);
   if (command == "supervised") {
@@ -139,8 +199,23 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         minCount = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-minCountLabel") {
         minCountLabel = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-vocabBudget") {
+        vocabBudget = std::stoll(args.at(ai + 1));
+      } else if (args[ai] == "-warmup") {
+        warmup = std::stoll(args.at(ai + 1));
+      } else if (args[ai] == "-tokenBudget") {
+        tokenBudget = std::stoll(args.at(ai + 1));
       } else if (args[ai] == "-neg") {
         neg = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-negPower") {
+        negPower = std::stod(args.at(ai + 1));
+      } else if (args[ai] == "-sharedNeg") {
+        sharedNeg = true;
+        ai--;
+      } else if (args[ai] == "-hotRows") {
+        hotRows = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-hotSync") {
+        hotSync = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-wordNgrams") {
         wordNgrams = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-loss") {
@@ -166,6 +241,47 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         maxn = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-thread") {
         thread = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-numa") {
+        if (args.at(ai + 1) == "none") {
+          numa = numa_policy::none;
+        } else if (args.at(ai + 1) == "interleave") {
+          numa = numa_policy::interleave;
+        } else if (args.at(ai + 1) == "local") {
+          numa = numa_policy::local;
+        } else {
+          std::cerr << "Unknown numa policy: " << args.at(ai + 1) << std::endl;
+          printHelp();
+          exit(EXIT_FAILURE);
+        }
+      } else if (args[ai] == "-precision") {
+        if (args.at(ai + 1) == "fp32") {
+          precision = precision_name::fp32;
+        } else if (args.at(ai + 1) == "bf16") {
+          precision = precision_name::bf16;
+        } else if (args.at(ai + 1) == "fp16") {
+          precision = precision_name::fp16;
+        } else {
+          std::cerr << "Unknown precision: " << args.at(ai + 1) << std::endl;
+          printHelp();
+          exit(EXIT_FAILURE);
+        }
+      } else if (args[ai] == "-fullRows") {
+        fullRows = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-padRows") {
+        padRows = true;
+        ai--;
+      } else if (args[ai] == "-pin") {
+        if (args.at(ai + 1) == "none") {
+          pin = pin_policy::none;
+        } else if (args.at(ai + 1) == "compact") {
+          pin = pin_policy::compact;
+        } else if (args.at(ai + 1) == "scatter") {
+          pin = pin_policy::scatter;
+        } else {
+          std::cerr << "Unknown pin policy: " << args.at(ai + 1) << std::endl;
+          printHelp();
+          exit(EXIT_FAILURE);
+        }
       } else if (args[ai] == "-t") {
         t = std::stof(args.at(ai + 1));
       } else if (args[ai] == "-label") {
@@ -174,9 +290,36 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         verbose = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-pretrainedVectors") {
         pretrainedVectors = std::string(args.at(ai + 1));
+      } else if (args[ai] == "-cache") {
+        cache = std::string(args.at(ai + 1));
+      } else if (args[ai] == "-cacheVarint") {
+        cacheVarint = true;
+        ai--;
       } else if (args[ai] == "-saveOutput") {
         saveOutput = true;
         ai--;
+      } else if (args[ai] == "-exportShards") {
+        exportShards = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-checkpoint") {
+        checkpoint = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-resume") {
+        resume = true;
+        ai--;
+      } else if (args[ai] == "-workers") {
+        workers = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-rank") {
+        rank = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-master") {
+        master = std::string(args.at(ai + 1));
+      } else if (args[ai] == "-syncTokens") {
+        syncTokens = std::stoll(args.at(ai + 1));
+      } else if (args[ai] == "-syncTopK") {
+        syncTopK = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-syncFp16") {
+        syncFp16 = true;
+        ai--;
+      } else if (args[ai] == "-shm") {
+        shm = std::string(args.at(ai + 1));
       } else if (args[ai] == "-seed") {
         seed = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-qnorm") {
@@ -215,11 +358,24 @@ void Args::parseArgs(const std::vector<std::string>& args) {
       exit(EXIT_FAILURE);
     }
   }
-  if (input.empty() || output.empty()) {
+  // quantize works from the saved model and only needs the output path
+  if ((input.empty() && command != "quantize") || output.empty()) {
     std::cerr << "Empty input or output path." << std::endl;
     printHelp();
     exit(EXIT_FAILURE);
   }
+  if (vocabBudget < 0) {
+    std::cerr << "-vocabBudget must be 0 (exact counts) or positive."
+              << std::endl;
+    printHelp();
+    exit(EXIT_FAILURE);
+  }
+  if (workers < 1 || rank < 0 || rank >= workers) {
+    std::cerr << "-workers must be at least 1 and -rank between 0 and "
+              << "-workers - 1." << std::endl;
+    printHelp();
+    exit(EXIT_FAILURE);
+  }
   if (wordNgrams <= 1 && maxn == 0 && !hasAutotune()) {
     bucket = 0;
   }
@@ -247,6 +403,10 @@ void Args::printDictionaryHelp() {
             << minCount << "]\n"
             << "  -minCountLabel      minimal number of label occurences ["
             << minCountLabel << "]\n"
+            << "  -vocabBudget        max words tracked while counting, 0 for exact counts ["
+            << vocabBudget << "]\n"
+            << "  -warmup             tokens of a stdin corpus read to build the vocabulary ["
+            << warmup << "]\n"
             << "  -wordNgrams         max length of word ngram [" << wordNgrams
             << "]\n"
             << "  -bucket             number of buckets [" << bucket << "]\n"
@@ -255,7 +415,11 @@ void Args::printDictionaryHelp() {
             << "  -maxn               max length of char ngram [" << maxn
             << "]\n"
             << "  -t                  sampling threshold [" << t << "]\n"
-            << "  -label              labels prefix [" << label << "]\n";
+            << "  -label              labels prefix [" << label << "]\n"
+            << "  -cache              pre-tokenized id cache of the input, built or reused ["
+            << cache << "]\n"
+            << "  -cacheVarint        varint-compress the id cache ["
+            << boolToString(cacheVarint) << "]\n";
 }
 
 void Args::printTrainingHelp() {
@@ -267,15 +431,54 @@ void Args::printTrainingHelp() {
       << "  -dim                size of word vectors [" << dim << "]\n"
       << "  -ws                 size of the context window [" << ws << "]\n"
       << "  -epoch              number of epochs [" << epoch << "]\n"
+      << "  -tokenBudget        tokens to train on, 0 for -epoch passes (estimated for stdin) ["
+      << tokenBudget << "]\n"
       << "  -neg                number of negatives sampled [" << neg << "]\n"
+      << "  -negPower           exponent of the counts in the negative distribution ["
+      << negPower << "]\n"
+      << "  -sharedNeg          share one draw of negatives across each window ["
+      << boolToString(sharedNeg) << "]\n"
+      << "  -hotRows            most frequent output rows each thread keeps a private copy of ["
+      << hotRows << "]\n"
+      << "  -hotSync            updates between merges of the private rows [" << hotSync
+      << "]\n"
       << "  -loss               loss function {ns, hs, softmax, one-vs-all} ["
       << lossToString(loss) << "]\n"
       << "  -thread             number of threads (set to 1 to ensure reproducible results) ["
       << thread << "]\n"
-      << "  -pretrainedVectors  pretrained word vectors for supervised learning ["
+      << "  -numa               placement of the matrices {none, interleave, local} ["
+      << numaToString(numa) << "]\n"
+      << "  -pin                bind training threads to cpus {none, compact, scatter} ["
+      << pinToString(pin) << "]\n"
+      << "  -padRows            pad matrix rows to whole cache lines ["
+      << boolToString(padRows) << "]\n"
+      << "  -precision          storage of the matrices while training {fp32, bf16, fp16} ["
+      << precisionToString(precision) << "]\n"
+      << "  -fullRows           most frequent rows kept in fp32 with bf16/fp16 ["
+      << fullRows << "]\n"
+      << "  -pretrainedVectors  model (.bin) or vectors (.vec) to continue training from ["
       << pretrainedVectors << "]\n"
       << "  -saveOutput         whether output params should be saved ["
       << boolToString(saveOutput) << "]\n"
+      << "  -exportShards       number of files the .vec and .output text is split into ["
+      << exportShards << "]\n"
+      << "  -checkpoint         seconds between checkpoints to <output>.ckpt, 0 for none ["
+      << checkpoint << "]\n"
+      << "  -resume             continue from <output>.ckpt if it exists ["
+      << boolToString(resume) << "]\n"
+      << "  -workers            processes training together, each on a slice of -input ["
+      << workers << "]\n"
+      << "  -rank               index of this process among the workers [" << rank << "]\n"
+      << "  -master             where rank 0 listens, unix:<path> or <host>:<port> ["
+      << master << "]\n"
+      << "  -syncTokens         tokens a worker trains between model averages ["
+      << syncTokens << "]\n"
+      << "  -syncTopK           rows per matrix a worker sends per average, 0 for all changed ["
+      << syncTopK << "]\n"
+      << "  -syncFp16           send the rows between workers in fp16 ["
+      << boolToString(syncFp16) << "]\n"
+      << "  -shm                train the -workers on one model in this shared memory"
+      << " segment [" << shm << "]\n"
       << "  -seed               random generator seed  [" << seed << "]\n";
 }
 
@@ -302,7 +505,7 @@ void Args::printQuantizationHelp() {
       << boolToString(retrain) << "]\n"
       << "  -qnorm              whether the norm is quantized separately ["
       << boolToString(qnorm) << "]\n"
-      << "  -qout               whether the classifier is quantized ["
+      << "  -qout               whether the output matrix is quantized, with -dsub ["
       << boolToString(qout) << "]\n"
       << "  -dsub               size of each sub-vector [" << dsub << "]\n";
 }
@@ -321,6 +524,20 @@ void Args::save(std::ostream& out) {
   out.write((char*)&(maxn), sizeof(int));
   out.write((char*)&(lrUpdateRate), sizeof(int));
   out.write((char*)&(t), sizeof(double));
+  out.write((char*)&(minCountLabel), sizeof(int));
+  out.write((char*)&(vocabBudget), sizeof(int64_t));
+  out.write((char*)&(warmup), sizeof(int64_t));
+  out.write((char*)&(tokenBudget), sizeof(int64_t));
+  out.write((char*)&(negPower), sizeof(double));
+  out.write((char*)&(sharedNeg), sizeof(bool));
+  out.write((char*)&(hotRows), sizeof(int));
+  out.write((char*)&(hotSync), sizeof(int));
+  out.write((char*)&(precision), sizeof(precision_name));
+  out.write((char*)&(fullRows), sizeof(int));
+  out.write((char*)&(workers), sizeof(int));
+  out.write((char*)&(syncTokens), sizeof(int64_t));
+  out.write((char*)&(syncTopK), sizeof(int));
+  out.write((char*)&(syncFp16), sizeof(bool));
 }
 
 void Args::load(std::istream& in) {
@@ -337,6 +554,20 @@ void Args::load(std::istream& in) {
   in.read((char*)&(maxn), sizeof(int));
   in.read((char*)&(lrUpdateRate), sizeof(int));
   in.read((char*)&(t), sizeof(double));
+  in.read((char*)&(minCountLabel), sizeof(int));
+  in.read((char*)&(vocabBudget), sizeof(int64_t));
+  in.read((char*)&(warmup), sizeof(int64_t));
+  in.read((char*)&(tokenBudget), sizeof(int64_t));
+  in.read((char*)&(negPower), sizeof(double));
+  in.read((char*)&(sharedNeg), sizeof(bool));
+  in.read((char*)&(hotRows), sizeof(int));
+  in.read((char*)&(hotSync), sizeof(int));
+  in.read((char*)&(precision), sizeof(precision_name));
+  in.read((char*)&(fullRows), sizeof(int));
+  in.read((char*)&(workers), sizeof(int));
+  in.read((char*)&(syncTokens), sizeof(int64_t));
+  in.read((char*)&(syncTopK), sizeof(int));
+  in.read((char*)&(syncFp16), sizeof(bool));
 }
 
 void Args::dump(std::ostream& out) const {
@@ -366,6 +597,34 @@ void Args::dump(std::ostream& out) const {
       << " " << lrUpdateRate << std::endl;
   out << "t"
       << " " << t << std::endl;
+  out << "minCountLabel"
+      << " " << minCountLabel << std::endl;
+  out << "vocabBudget"
+      << " " << vocabBudget << std::endl;
+  out << "warmup"
+      << " " << warmup << std::endl;
+  out << "tokenBudget"
+      << " " << tokenBudget << std::endl;
+  out << "negPower"
+      << " " << negPower << std::endl;
+  out << "sharedNeg"
+      << " " << boolToString(sharedNeg) << std::endl;
+  out << "hotRows"
+      << " " << hotRows << std::endl;
+  out << "hotSync"
+      << " " << hotSync << std::endl;
+  out << "precision"
+      << " " << precisionToString(precision) << std::endl;
+  out << "fullRows"
+      << " " << fullRows << std::endl;
+  out << "workers"
+      << " " << workers << std::endl;
+  out << "syncTokens"
+      << " " << syncTokens << std::endl;
+  out << "syncTopK"
+      << " " << syncTopK << std::endl;
+  out << "syncFp16"
+      << " " << boolToString(syncFp16) << std::endl;
 }
 
 bool Args::hasAutotune() const {
@@ -19,12 +19,18 @@ namespace fasttext {
 enum class model_name : int { cbow = 1, sg, sup };
 enum class loss_name : int { hs = 1, ns, softmax, ova };
 enum class metric_name : int { f1score = 1, labelf1score };
+enum class numa_policy : int { none = 1, interleave, local };
+enum class pin_policy : int { none = 1, compact, scatter };
+enum class precision_name : int { fp32 = 1, bf16, fp16 };
 
 class Args {
  protected:
   std::string boolToString(bool) const;
   std::string modelToString(model_name) const;
   std::string metricToString(metric_name) const;
+  std::string numaToString(numa_policy) const;
+  std::string pinToString(pin_policy) const;
+  std::string precisionToString(precision_name) const;
   std::unordered_set<std::string> manualArgs_;
 
  public:
@@ -38,7 +44,14 @@ class Args {
   int epoch;
   int minCount;
   int minCountLabel;
+  int64_t vocabBudget;
+  int64_t warmup;
+  int64_t tokenBudget;
   int neg;
+  double negPower;
+  bool sharedNeg;
+  int hotRows;
+  int hotSync;
   int wordNgrams;
   loss_name loss;
   model_name model;
@@ -46,11 +59,28 @@ class Args {
   int minn;
   int maxn;
   int thread;
+  numa_policy numa;
+  pin_policy pin;
+  bool padRows;
+  precision_name precision;
+  int fullRows;
   double t;
   std::string label;
   int verbose;
   std::string pretrainedVectors;
+  std::string cache;
+  bool cacheVarint;
   bool saveOutput;
+  int exportShards;
+  int checkpoint;
+  bool resume;
+  int workers;
+  int rank;
+  std::string master;
+  int64_t syncTokens;
+  int syncTopK;
+  bool syncFp16;
+  std::string shm;
   int seed;
 
   bool qout;
@@ -0,0 +1,549 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "averager.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "kernels.h"
+#include "vector.h"
+
+namespace fasttext {
+
+namespace {
+
+const int CONNECT_TIMEOUT_SECONDS = 60;
+const std::string MISMATCH =
+    ": are the dictionary, -dim, -thread and -syncFp16 the same for every"
+    " worker?";
+
+// -master is "unix:<path>" or "<host>:<port>"
+bool isUnix(const std::string& master) {
+  return master.compare(0, 5, "unix:") == 0;
+}
+
+sockaddr_un unixAddress(const std::string& master) {
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::string path = master.substr(5);
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    throw std::invalid_argument("Invalid -master socket path: " + path);
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+
+addrinfo* tcpAddresses(const std::string& master, bool passive) {
+  size_t colon = master.rfind(':');
+  if (colon == std::string::npos) {
+    throw std::invalid_argument(
+        "-master must be unix:<path> or <host>:<port>, not " + master);
+  }
+  std::string host = master.substr(0, colon);
+  std::string port = master.substr(colon + 1);
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  addrinfo* result = nullptr;
+  if (getaddrinfo(
+          host.empty() ? nullptr : host.c_str(),
+          port.c_str(),
+          &hints,
+          &result) != 0) {
+    throw std::invalid_argument("Cannot resolve -master " + master);
+  }
+  return result;
+}
+
+int listenOn(const std::string& master, int backlog) {
+  if (isUnix(master)) {
+    sockaddr_un addr = unixAddress(master);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(addr.sun_path);
+    if (fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(fd, backlog) != 0) {
+      if (fd >= 0) {
+        close(fd);
+      }
+      throw std::runtime_error("Cannot listen on " + master);
+    }
+    return fd;
+  }
+  addrinfo* addrs = tcpAddresses(master, true);
+  int fd = -1;
+  for (addrinfo* a = addrs; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, a->ai_addr, a->ai_addrlen) != 0 || listen(fd, backlog) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addrs);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot listen on " + master);
+  }
+  return fd;
+}
+
+// -1 if nobody listens yet
+int connectTo(const std::string& master) {
+  if (isUnix(master)) {
+    sockaddr_un addr = unixAddress(master);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+    return fd;
+  }
+  addrinfo* addrs = tcpAddresses(master, false);
+  int fd = -1;
+  for (addrinfo* a = addrs; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addrs);
+  if (fd >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+void writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("Lost the connection to another worker");
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+void readAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = ::recv(fd, data, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      throw std::runtime_error("Lost the connection to another worker");
+    }
+    data += n;
+    size -= n;
+  }
+}
+
+template <typename T>
+void append(std::vector<char>& out, const T& value) {
+  const char* p = reinterpret_cast<const char*>(&value);
+  out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T take(const char*& in, const char* end) {
+  if (end - in < int64_t(sizeof(T))) {
+    throw std::runtime_error("Malformed message from another worker");
+  }
+  T value;
+  std::memcpy(&value, in, sizeof(T));
+  in += sizeof(T);
+  return value;
+}
+
+} // namespace
+
+ModelAverager::ModelAverager(
+    std::shared_ptr<const Args> args,
+    int32_t nwords,
+    std::vector<std::shared_ptr<Matrix>> matrices)
+    : args_(args),
+      nwords_(nwords),
+      matrices_(matrices),
+      rounds_(0),
+      bytesSent_(0) {
+  if (args_->master.empty()) {
+    throw std::invalid_argument("-workers needs a -master address!");
+  }
+  if (args_->rank < 0 || args_->rank >= args_->workers) {
+    throw std::invalid_argument("-rank must be in [0, -workers)!");
+  }
+  for (const auto& matrix : matrices_) {
+    const int64_t m = matrix->size(0), n = matrix->size(1);
+    std::vector<real> base(m * n);
+    Vector row(n);
+    for (int64_t i = 0; i < m; i++) {
+      row.zero();
+      matrix->addRowToVector(row, i);
+      std::copy(row.data(), row.data() + n, base.data() + i * n);
+    }
+    base_.push_back(std::move(base));
+  }
+
+  const std::vector<int64_t> ours = hello();
+  if (args_->rank == 0) {
+    int server = listenOn(args_->master, args_->workers);
+    peers_.assign(args_->workers - 1, -1);
+    for (int32_t i = 1; i < args_->workers; i++) {
+      int fd = accept(server, nullptr, nullptr);
+      if (fd < 0 && errno == EINTR) {
+        i--;
+        continue;
+      }
+      std::vector<int64_t> theirs(ours.size(), -1);
+      if (fd >= 0) {
+        readAll(fd, (char*)theirs.data(), theirs.size() * sizeof(int64_t));
+      }
+      const int64_t rank = theirs[0];
+      if (rank < 1 || rank >= args_->workers || peers_[rank - 1] >= 0) {
+        if (fd >= 0) {
+          close(fd);
+        }
+        close(server);
+        closePeers();
+        throw std::runtime_error("Unexpected worker on " + args_->master);
+      }
+      peers_[rank - 1] = fd;
+      const int32_t accepted =
+          std::equal(ours.begin() + 1, ours.end(), theirs.begin() + 1);
+      writeAll(fd, (const char*)&accepted, sizeof(accepted));
+      if (!accepted) {
+        close(server);
+        closePeers();
+        throw std::invalid_argument(
+            "Rank " + std::to_string(rank) + " trains another model" +
+            MISMATCH);
+      }
+    }
+    close(server);
+  } else {
+    int fd = -1;
+    auto start = std::chrono::steady_clock::now();
+    while ((fd = connectTo(args_->master)) < 0) {
+      if (std::chrono::steady_clock::now() - start >
+          std::chrono::seconds(CONNECT_TIMEOUT_SECONDS)) {
+        throw std::runtime_error("Cannot connect to " + args_->master);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    peers_.push_back(fd);
+    writeAll(fd, (const char*)ours.data(), ours.size() * sizeof(int64_t));
+    int32_t accepted = 0;
+    readAll(fd, (char*)&accepted, sizeof(accepted));
+    if (!accepted) {
+      closePeers();
+      throw std::invalid_argument("Rank 0 trains another model" + MISMATCH);
+    }
+  }
+}
+
+ModelAverager::~ModelAverager() {
+  closePeers();
+}
+
+void ModelAverager::closePeers() {
+  for (int& fd : peers_) {
+    if (fd >= 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+}
+
+// What a worker sends rank 0 when it connects: its rank, then what has to
+// be the same on every worker for the rows they send to line up.
+std::vector<int64_t> ModelAverager::hello() const {
+  std::vector<int64_t> hello = {
+      args_->rank, nwords_, args_->dim, args_->syncFp16, args_->thread};
+  for (const auto& matrix : matrices_) {
+    hello.push_back(matrix->size(0));
+  }
+  return hello;
+}
+
+int64_t ModelAverager::rounds() const {
+  return rounds_;
+}
+
+int64_t ModelAverager::bytesSent() const {
+  return bytesSent_;
+}
+
+// Rows that differ from base_, in increasing order, as deltas rounded the
+// way they are sent.
+ModelAverager::Rows ModelAverager::collect(int32_t matrix, bool all) const {
+  const Matrix& current = *matrices_[matrix];
+  const std::vector<real>& base = base_[matrix];
+  const int64_t m = current.size(0), n = current.size(1);
+  Rows rows;
+  std::vector<real> norms;
+  Vector row(n);
+  for (int64_t i = 0; i < m; i++) {
+    row.zero();
+    current.addRowToVector(row, i);
+    real norm = 0.0;
+    for (int64_t j = 0; j < n; j++) {
+      row[j] -= base[i * n + j];
+      norm += row[j] * row[j];
+    }
+    if (norm > 0.0) {
+      rows.ids.push_back(i);
+      rows.values.insert(rows.values.end(), row.data(), row.data() + n);
+      norms.push_back(norm);
+    }
+  }
+  const size_t k = args_->syncTopK;
+  if (!all && k > 0 && rows.ids.size() > k) {
+    std::vector<int32_t> order(rows.ids.size());
+    for (size_t i = 0; i < order.size(); i++) {
+      order[i] = i;
+    }
+    std::nth_element(
+        order.begin(), order.begin() + k, order.end(), [&](int32_t a, int32_t b) {
+          return norms[a] > norms[b];
+        });
+    order.resize(k);
+    std::sort(order.begin(), order.end());
+    Rows top;
+    for (int32_t i : order) {
+      top.ids.push_back(rows.ids[i]);
+      top.values.insert(
+          top.values.end(),
+          rows.values.begin() + i * n,
+          rows.values.begin() + (i + 1) * n);
+    }
+    rows = std::move(top);
+  }
+  if (args_->syncFp16) {
+    std::vector<uint16_t> half(rows.values.size());
+    kernels::get().floatToFp16(rows.values.data(), half.data(), half.size());
+    kernels::get().fp16ToFloat(half.data(), rows.values.data(), half.size());
+  }
+  return rows;
+}
+
+// base_ += average; the matrix gets average - sent added, so that it keeps
+// both what its threads did since the round started and what was not sent.
+// In the last round nothing is left unsent (but fp16 rounding, which is
+// dropped) and the rows are set to base_, bit-identical on every worker.
+void ModelAverager::apply(
+    int32_t matrix,
+    const Rows& average,
+    const Rows& sent,
+    bool last) {
+  std::vector<real>& base = base_[matrix];
+  const int64_t n = matrices_[matrix]->size(1);
+  Vector delta(n);
+  size_t s = 0;
+  for (size_t r = 0; r < average.ids.size(); r++) {
+    const int32_t i = average.ids[r];
+    const real* avg = average.values.data() + r * n;
+    while (s < sent.ids.size() && sent.ids[s] < i) {
+      s++;
+    }
+    const real* own = s < sent.ids.size() && sent.ids[s] == i
+        ? sent.values.data() + s * n
+        : nullptr;
+    for (int64_t j = 0; j < n; j++) {
+      base[i * n + j] += avg[j];
+      delta[j] = own ? avg[j] - own[j] : avg[j];
+    }
+    if (last) {
+      std::copy(base.data() + i * n, base.data() + (i + 1) * n, delta.data());
+      matrices_[matrix]->scalerMulRow(0.0, i);
+    }
+    matrices_[matrix]->addVectorToRow(delta, i, 1.0);
+  }
+}
+
+// int64 row count, the row ids, then the values as fp32 or fp16
+void ModelAverager::encode(const Rows& rows, std::vector<char>& out) const {
+  append(out, int64_t(rows.ids.size()));
+  const char* ids = reinterpret_cast<const char*>(rows.ids.data());
+  out.insert(out.end(), ids, ids + rows.ids.size() * sizeof(int32_t));
+  if (args_->syncFp16) {
+    std::vector<uint16_t> half(rows.values.size());
+    kernels::get().floatToFp16(rows.values.data(), half.data(), half.size());
+    const char* p = reinterpret_cast<const char*>(half.data());
+    out.insert(out.end(), p, p + half.size() * sizeof(uint16_t));
+  } else {
+    const char* p = reinterpret_cast<const char*>(rows.values.data());
+    out.insert(out.end(), p, p + rows.values.size() * sizeof(real));
+  }
+}
+
+void ModelAverager::decode(
+    const char*& in,
+    const char* end,
+    int32_t matrix,
+    Rows& rows) const {
+  const int64_t m = matrices_[matrix]->size(0), n = matrices_[matrix]->size(1);
+  const int64_t k = take<int64_t>(in, end);
+  const int64_t width = args_->syncFp16 ? sizeof(uint16_t) : sizeof(real);
+  if (k < 0 || end - in < k * int64_t(sizeof(int32_t)) + k * n * width) {
+    throw std::runtime_error("Malformed message from another worker");
+  }
+  rows.ids.resize(k);
+  std::memcpy(rows.ids.data(), in, k * sizeof(int32_t));
+  in += k * sizeof(int32_t);
+  for (int32_t id : rows.ids) {
+    if (id < 0 || id >= m) {
+      throw std::runtime_error("Malformed message from another worker");
+    }
+  }
+  rows.values.resize(k * n);
+  if (args_->syncFp16) {
+    std::vector<uint16_t> half(k * n);
+    std::memcpy(half.data(), in, half.size() * sizeof(uint16_t));
+    kernels::get().fp16ToFloat(half.data(), rows.values.data(), half.size());
+  } else {
+    std::memcpy(rows.values.data(), in, rows.values.size() * sizeof(real));
+  }
+  in += k * n * width;
+}
+
+void ModelAverager::send(int fd, const std::vector<char>& message) {
+  const int64_t size = message.size();
+  writeAll(fd, (const char*)&size, sizeof(size));
+  writeAll(fd, message.data(), message.size());
+  bytesSent_ += sizeof(size) + size;
+}
+
+std::vector<char> ModelAverager::receive(int fd) {
+  int64_t size = 0;
+  readAll(fd, (char*)&size, sizeof(size));
+  if (size < 0) {
+    throw std::runtime_error("Malformed message from another worker");
+  }
+  std::vector<char> message(size);
+  readAll(fd, message.data(), size);
+  return message;
+}
+
+// Messages: an int32 flag (done for a worker, last round for rank 0)
+// followed by the rows of each matrix.
+bool ModelAverager::round(bool done) {
+  const int32_t nmatrices = matrices_.size();
+  std::vector<Rows> sent(nmatrices);
+  for (int32_t i = 0; i < nmatrices; i++) {
+    sent[i] = collect(i, done);
+  }
+
+  std::vector<Rows> average(nmatrices);
+  bool last = done;
+  if (args_->rank == 0) {
+    std::vector<std::vector<Rows>> received(peers_.size());
+    for (size_t p = 0; p < peers_.size(); p++) {
+      std::vector<char> message = receive(peers_[p]);
+      const char* in = message.data();
+      const char* end = in + message.size();
+      last = take<int32_t>(in, end) != 0 && last;
+      received[p].resize(nmatrices);
+      for (int32_t i = 0; i < nmatrices; i++) {
+        decode(in, end, i, received[p][i]);
+      }
+    }
+    for (int32_t i = 0; i < nmatrices; i++) {
+      const int64_t m = matrices_[i]->size(0), n = matrices_[i]->size(1);
+      std::vector<int32_t> slot(m, -1), count;
+      std::vector<real> sums;
+      auto add = [&](const Rows& rows) {
+        for (size_t r = 0; r < rows.ids.size(); r++) {
+          int32_t& s = slot[rows.ids[r]];
+          if (s < 0) {
+            s = count.size();
+            count.push_back(0);
+            sums.resize(sums.size() + n, 0.0);
+          }
+          count[s]++;
+          for (int64_t j = 0; j < n; j++) {
+            sums[s * n + j] += rows.values[r * n + j];
+          }
+        }
+      };
+      add(sent[i]);
+      for (const auto& rows : received) {
+        add(rows[i]);
+      }
+      for (int64_t row = 0; row < m; row++) {
+        const int32_t s = slot[row];
+        if (s < 0) {
+          continue;
+        }
+        average[i].ids.push_back(row);
+        for (int64_t j = 0; j < n; j++) {
+          average[i].values.push_back(sums[s * n + j] / count[s]);
+        }
+      }
+      if (args_->syncFp16) {
+        // everybody applies the values as decoded from the reply
+        std::vector<uint16_t> half(average[i].values.size());
+        kernels::get().floatToFp16(
+            average[i].values.data(), half.data(), half.size());
+        kernels::get().fp16ToFloat(
+            half.data(), average[i].values.data(), half.size());
+      }
+    }
+    std::vector<char> reply;
+    append(reply, int32_t(last));
+    for (int32_t i = 0; i < nmatrices; i++) {
+      encode(average[i], reply);
+    }
+    for (int fd : peers_) {
+      send(fd, reply);
+    }
+  } else {
+    std::vector<char> message;
+    append(message, int32_t(done));
+    for (int32_t i = 0; i < nmatrices; i++) {
+      encode(sent[i], message);
+    }
+    send(peers_[0], message);
+    std::vector<char> reply = receive(peers_[0]);
+    const char* in = reply.data();
+    const char* end = in + reply.size();
+    last = take<int32_t>(in, end) != 0;
+    for (int32_t i = 0; i < nmatrices; i++) {
+      decode(in, end, i, average[i]);
+    }
+  }
+  for (int32_t i = 0; i < nmatrices; i++) {
+    apply(i, average[i], sent[i], last);
+  }
+  rounds_++;
+  return !last;
+}
+
+} // namespace fasttext
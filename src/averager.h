@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+// Data-parallel training across processes (-workers). Each worker keeps
+// the model as of the last round; in a round it sends the rows that moved
+// since then (the -syncTopK largest moves, fp16 with -syncFp16) to rank 0,
+// which averages every row over the workers that sent it and sends the
+// averages back. Workers add them in place while their threads keep
+// training, and what they did not send stays in their copy for a later
+// round. Rank 0 listens on -master, "unix:<path>" or "<host>:<port>", and
+// turns away workers whose model does not have the same shape.
+class ModelAverager {
+ public:
+  ModelAverager(
+      std::shared_ptr<const Args> args,
+      int32_t nwords,
+      std::vector<std::shared_ptr<Matrix>> matrices);
+  ModelAverager(const ModelAverager&) = delete;
+  ModelAverager& operator=(const ModelAverager&) = delete;
+  ~ModelAverager();
+
+  // One round; `done` once this worker has finished training, which also
+  // sends every moved row. Returns false after the last round, the first
+  // one in which all workers were done.
+  bool round(bool done);
+
+  int64_t rounds() const;
+  int64_t bytesSent() const;
+
+ private:
+  struct Rows {
+    std::vector<int32_t> ids;
+    std::vector<real> values;
+  };
+
+  std::vector<int64_t> hello() const;
+  void closePeers();
+  Rows collect(int32_t matrix, bool all) const;
+  void apply(
+      int32_t matrix,
+      const Rows& average,
+      const Rows& sent,
+      bool last);
+  void encode(const Rows& rows, std::vector<char>& out) const;
+  void decode(const char*& in, const char* end, int32_t matrix, Rows& rows)
+      const;
+  void send(int fd, const std::vector<char>& message);
+  std::vector<char> receive(int fd);
+
+  std::shared_ptr<const Args> args_;
+  int32_t nwords_;
+  std::vector<std::shared_ptr<Matrix>> matrices_;
+  // the model after the last round, identical on every worker
+  std::vector<std::vector<real>> base_;
+  // rank 0: one socket per other worker, indexed by rank - 1; others: the
+  // socket to rank 0
+  std::vector<int> peers_;
+  int64_t rounds_;
+  int64_t bytesSent_;
+};
+
+} // namespace fasttext
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "corpuscache.h"
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace fasttext {
+
+namespace {
+
+constexpr uint64_t FNV_OFFSET_64 = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME_64 = 1099511628211ULL;
+constexpr int64_t HASH_SAMPLE_BYTES = 1 << 20;
+
+uint64_t fnv64(uint64_t h, const char* data, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    h = (h ^ uint8_t(data[i])) * FNV_PRIME_64;
+  }
+  return h;
+}
+
+template <typename T>
+uint64_t fnv64(uint64_t h, const T& value) {
+  return fnv64(h, reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeVarint(std::ostream& out, uint32_t v) {
+  char buf[5];
+  int n = 0;
+  while (v >= 0x80) {
+    buf[n++] = char((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = char(v);
+  out.write(buf, n);
+}
+
+} // namespace
+
+CorpusCache::CorpusCache(const std::string& path)
+    : file_(new utils::MappedFile(path)),
+      header_(nullptr),
+      stream_(nullptr),
+      offsets_(nullptr) {
+  if (file_->size() < int64_t(sizeof(Header))) {
+    throw std::invalid_argument(path + " is not a corpus cache!");
+  }
+  header_ = reinterpret_cast<const Header*>(file_->data());
+  if (header_->magic != CACHE_MAGIC_INT32 ||
+      header_->version != CACHE_VERSION ||
+      header_->offsetsPos % int64_t(sizeof(int64_t)) != 0 ||
+      header_->offsetsPos + (header_->nlines + 1) * int64_t(sizeof(int64_t)) !=
+          file_->size()) {
+    throw std::invalid_argument(path + " is not a corpus cache!");
+  }
+  stream_ = reinterpret_cast<const uint8_t*>(file_->data() + sizeof(Header));
+  offsets_ =
+      reinterpret_cast<const int64_t*>(file_->data() + header_->offsetsPos);
+}
+
+int64_t CorpusCache::nlines() const {
+  return header_->nlines;
+}
+
+int64_t CorpusCache::ntokens() const {
+  return header_->ntokens;
+}
+
+bool CorpusCache::matches(uint64_t corpusHash, uint64_t vocabHash) const {
+  return header_->corpusHash == corpusHash && header_->vocabHash == vocabHash;
+}
+
+int64_t CorpusCache::startLine(int32_t threadId, int32_t nthreads) const {
+  return threadId * nlines() / nthreads;
+}
+
+void CorpusCache::decode(int64_t line, std::vector<int32_t>& ids) const {
+  const uint8_t* p = stream_ + offsets_[line];
+  const uint8_t* end = stream_ + offsets_[line + 1];
+  ids.clear();
+  if (!header_->varint) {
+    const int32_t* q = reinterpret_cast<const int32_t*>(p);
+    ids.assign(q, reinterpret_cast<const int32_t*>(end));
+    return;
+  }
+  while (p < end) {
+    uint32_t v = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+      v |= uint32_t(*p++ & 0x7f) << shift;
+      shift += 7;
+    }
+    v |= uint32_t(*p++) << shift;
+    ids.push_back(int32_t(v));
+  }
+}
+
+int32_t CorpusCache::getLine(
+    int64_t& line,
+    std::vector<int32_t>& words,
+    const Dictionary& dict,
+    Rng& rng) const {
+  if (nlines() == 0) {
+    words.clear();
+    return 0;
+  }
+  if (line >= nlines()) {
+    line = 0;
+  }
+  decode(line, words);
+  line++;
+  int32_t ntokens = words.size();
+  int32_t kept = 0;
+  for (int32_t i = 0; i < ntokens; i++) {
+    if (!dict.discard(words[i], rng.next32())) {
+      words[kept++] = words[i];
+    }
+  }
+  words.resize(kept);
+  return ntokens;
+}
+
+void CorpusCache::build(
+    const std::string& path,
+    std::istream& in,
+    const Dictionary& dict,
+    uint64_t corpusHash,
+    uint64_t vocabHash,
+    bool varint) {
+  const std::string tmpPath = path + ".tmp";
+  const std::string offsetsPath = path + ".tmp.idx";
+  std::ofstream out(tmpPath, std::ofstream::binary);
+  std::ofstream offsets(offsetsPath, std::ofstream::binary);
+  if (!out.is_open() || !offsets.is_open()) {
+    throw std::invalid_argument(path + " cannot be opened for saving!");
+  }
+  Header header = Header();
+  header.magic = CACHE_MAGIC_INT32;
+  header.version = CACHE_VERSION;
+  header.varint = varint;
+  header.corpusHash = corpusHash;
+  header.vocabHash = vocabHash;
+  out.write((char*)&header, sizeof(Header));
+
+  std::vector<int32_t> ids;
+  int64_t pos = 0;
+  offsets.write((char*)&pos, sizeof(int64_t));
+  while (!in.eof()) {
+    int32_t ntokens = dict.getLine(in, ids);
+    if (ntokens == 0) {
+      continue;
+    }
+    if (varint) {
+      for (int32_t id : ids) {
+        writeVarint(out, uint32_t(id));
+      }
+    } else {
+      out.write((char*)ids.data(), ids.size() * sizeof(int32_t));
+    }
+    pos = int64_t(out.tellp()) - int64_t(sizeof(Header));
+    offsets.write((char*)&pos, sizeof(int64_t));
+    header.nlines++;
+    header.ntokens += ntokens;
+  }
+  offsets.close();
+
+  // the offsets are read in place as int64_t
+  header.offsetsPos = int64_t(out.tellp());
+  while (header.offsetsPos % sizeof(int64_t) != 0) {
+    out.put(0);
+    header.offsetsPos++;
+  }
+  std::ifstream offsetsIn(offsetsPath, std::ifstream::binary);
+  out << offsetsIn.rdbuf();
+  offsetsIn.close();
+  std::remove(offsetsPath.c_str());
+  out.seekp(0);
+  out.write((char*)&header, sizeof(Header));
+  out.close();
+  if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    std::remove(tmpPath.c_str());
+    throw std::runtime_error(path + " cannot be written!");
+  }
+}
+
+// Size, modification time and the first and last megabyte of the file.
+uint64_t CorpusCache::hashCorpus(const std::string& filename) {
+  struct stat st;
+  if (stat(filename.c_str(), &st) != 0) {
+    throw std::invalid_argument(filename + " cannot be opened!");
+  }
+  uint64_t h = FNV_OFFSET_64;
+  h = fnv64(h, int64_t(st.st_size));
+  h = fnv64(h, int64_t(st.st_mtim.tv_sec));
+  h = fnv64(h, int64_t(st.st_mtim.tv_nsec));
+  std::ifstream ifs(filename, std::ifstream::binary);
+  std::vector<char> buf(HASH_SAMPLE_BYTES);
+  ifs.read(buf.data(), buf.size());
+  h = fnv64(h, buf.data(), ifs.gcount());
+  if (st.st_size > HASH_SAMPLE_BYTES) {
+    ifs.clear();
+    ifs.seekg(std::max(int64_t(st.st_size) - HASH_SAMPLE_BYTES, HASH_SAMPLE_BYTES));
+    ifs.read(buf.data(), buf.size());
+    h = fnv64(h, buf.data(), ifs.gcount());
+  }
+  return h;
+}
+
+uint64_t CorpusCache::hashVocabulary(const Dictionary& dict) {
+  uint64_t h = FNV_OFFSET_64;
+  h = fnv64(h, dict.nwords());
+  for (int32_t i = 0; i < dict.nwords(); i++) {
+    std::string word = dict.getWord(i);
+    h = fnv64(h, word.data(), word.size() + 1);
+  }
+  return h;
+}
+
+} // namespace fasttext
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dictionary.h"
+#include "rng.h"
+#include "utils.h"
+
+namespace fasttext {
+
+// Pre-tokenized copy of the training corpus: the in-vocabulary ids of every
+// line Dictionary::getLine would return, before subsampling. Ids are stored
+// as raw int32 or as LEB128 varints, followed by an 8-byte aligned table of
+// line offsets.
+// The file is memory-mapped and shared by all training threads.
+class CorpusCache {
+ protected:
+  static const int32_t CACHE_MAGIC_INT32 = 0x46544944; // "DITF"
+  static const int32_t CACHE_VERSION = 1;
+
+  struct Header {
+    int32_t magic;
+    int32_t version;
+    int32_t varint;
+    int32_t reserved;
+    uint64_t corpusHash;
+    uint64_t vocabHash;
+    int64_t nlines;
+    int64_t ntokens;
+    int64_t offsetsPos;
+  };
+
+  std::unique_ptr<utils::MappedFile> file_;
+  const Header* header_;
+  const uint8_t* stream_;
+  const int64_t* offsets_;
+
+  void decode(int64_t line, std::vector<int32_t>& ids) const;
+
+ public:
+  explicit CorpusCache(const std::string& path);
+
+  int64_t nlines() const;
+  int64_t ntokens() const;
+  bool matches(uint64_t corpusHash, uint64_t vocabHash) const;
+
+  // First line a thread starts from, spread evenly over the corpus.
+  int64_t startLine(int32_t threadId, int32_t nthreads) const;
+  // Reads the line at `line` into `words`, applying the same subsampling
+  // as Dictionary::getLine, and moves `line` forward, wrapping at the end.
+  int32_t getLine(
+      int64_t& line,
+      std::vector<int32_t>& words,
+      const Dictionary& dict,
+      Rng& rng) const;
+
+  static void build(
+      const std::string& path,
+      std::istream& in,
+      const Dictionary& dict,
+      uint64_t corpusHash,
+      uint64_t vocabHash,
+      bool varint);
+  static uint64_t hashCorpus(const std::string& filename);
+  static uint64_t hashVocabulary(const Dictionary& dict);
+};
+
+} // namespace fasttext
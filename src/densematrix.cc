@@ -8,10 +8,13 @@
 
 #include "densematrix.h"
 
-#include <random>
+#include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <thread>
 #include <utility>
+#include "kernels.h"
+#include "rng.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -19,33 +22,148 @@ namespace fasttext {
 
 DenseMatrix::DenseMatrix() : DenseMatrix(0, 0) {}
 
-DenseMatrix::DenseMatrix(int64_t m, int64_t n) : Matrix(m, n), data_(m * n) {}
+DenseMatrix::DenseMatrix(int64_t m, int64_t n)
+    : Matrix(m, n), stride_(n), numa_(numa_policy::none) {
+  allocate();
+}
+
+DenseMatrix::DenseMatrix(const DenseMatrix& other)
+    : Matrix(other.m_, other.n_),
+      stride_(other.stride_),
+      numa_(numa_policy::none) {
+  allocate();
+  std::copy(other.data_, other.data_ + m_ * stride_, data_);
+}
 
 DenseMatrix::DenseMatrix(DenseMatrix&& other) noexcept
-    : Matrix(other.m_, other.n_), data_(std::move(other.data_)) {}
+    : Matrix(other.m_, other.n_),
+      stride_(other.stride_),
+      data_(other.data_),
+      storage_(std::move(other.storage_)),
+      mapping_(std::move(other.mapping_)),
+      segment_(std::move(other.segment_)),
+      memory_(std::move(other.memory_)),
+      numa_(other.numa_) {
+  other.data_ = nullptr;
+}
 
 DenseMatrix::DenseMatrix(int64_t m, int64_t n, real* dataPtr)
-    : Matrix(m, n), data_(dataPtr, dataPtr + (m * n)) {}
+    : Matrix(m, n), stride_(n), numa_(numa_policy::none) {
+  allocate();
+  std::copy(dataPtr, dataPtr + m * n, data_);
+}
+
+DenseMatrix::DenseMatrix(int64_t m, int64_t n, numa_policy numa, bool padded)
+    : Matrix(m, n),
+      stride_(padded ? paddedStride(n) : n),
+      memory_(new utils::AnonymousMemory(m * stride_ * sizeof(real))),
+      numa_(numa) {
+  data_ = reinterpret_cast<real*>(memory_->data());
+  if (numa_ == numa_policy::interleave) {
+    utils::numaInterleave(data_, memory_->size());
+  }
+}
+
+DenseMatrix::DenseMatrix(
+    int64_t m,
+    int64_t n,
+    std::shared_ptr<utils::MappedFile> mapping,
+    int64_t offset)
+    : Matrix(m, n), stride_(n), mapping_(mapping), numa_(numa_policy::none) {
+  if (offset < 0 || offset + m * n * int64_t(sizeof(real)) > mapping->size()) {
+    throw std::invalid_argument("Matrix does not fit in the mapped file!");
+  }
+  data_ = reinterpret_cast<real*>(const_cast<char*>(mapping->data() + offset));
+}
+
+DenseMatrix::DenseMatrix(
+    int64_t m,
+    int64_t n,
+    std::shared_ptr<utils::SharedMemory> segment,
+    int64_t offset,
+    bool padded)
+    : Matrix(m, n),
+      stride_(padded ? paddedStride(n) : n),
+      segment_(segment),
+      numa_(numa_policy::none) {
+  if (offset < 0 || offset % ROW_ALIGNMENT != 0 ||
+      offset + m * stride_ * int64_t(sizeof(real)) > segment->size()) {
+    throw std::invalid_argument("Matrix does not fit in the shared segment!");
+  }
+  data_ = reinterpret_cast<real*>(segment->data() + offset);
+}
+
+int64_t DenseMatrix::paddedStride(int64_t n) {
+  const int64_t width = ROW_ALIGNMENT / sizeof(real);
+  return (n + width - 1) / width * width;
+}
+
+// storage_ is over-allocated by one alignment unit so that data_ can start
+// on a ROW_ALIGNMENT boundary
+void DenseMatrix::allocate() {
+  mapping_ = nullptr;
+  memory_.reset();
+  storage_.assign(m_ * stride_ + ROW_ALIGNMENT / sizeof(real), 0.0);
+  uintptr_t p = reinterpret_cast<uintptr_t>(storage_.data());
+  p = (p + ROW_ALIGNMENT - 1) & ~uintptr_t(ROW_ALIGNMENT - 1);
+  data_ = reinterpret_cast<real*>(p);
+}
 
 void DenseMatrix::zero() {
-  std::fill(data_.begin(), data_.end(), 0.0);
+  std::fill(data_, data_ + m_ * stride_, 0.0);
 }
 
-void DenseMatrix::uniformThread(real a, int block, int32_t seed) {
-  std::minstd_rand rng(block + seed);
-  std::uniform_real_distribution<> uniform(-a, a);
-  int64_t blockSize = (m_ * n_) / 10;
-  for (int64_t i = blockSize * block;
-       i < (m_ * n_) && i < blockSize * (block + 1);
-       i++) {
-    data_[i] = uniform(rng);
+void DenseMatrix::uniformThread(
+    real a,
+    int64_t chunkBegin,
+    int64_t chunkEnd,
+    int32_t seed) {
+  const int64_t begin = chunkBegin * INIT_CHUNK;
+  const int64_t end = std::min(m_ * n_, chunkEnd * INIT_CHUNK);
+  if (begin >= end) {
+    return;
+  }
+  if (numa_ == numa_policy::local) {
+    const real* first = row(begin / n_);
+    const real* last = row((end - 1) / n_) + stride_;
+    utils::numaBind(
+        const_cast<real*>(first),
+        (last - first) * sizeof(real),
+        utils::currentNumaNode());
+  }
+  // values follow the logical (unpadded) order, so the stride does not
+  // change them
+  const double scale = 2.0 * a / double(uint64_t(1) << 53);
+  int64_t r = begin / n_, c = begin % n_;
+  for (int64_t chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+    Rng rng((uint64_t(uint32_t(seed)) << 32) | uint64_t(chunk));
+    const int64_t last = std::min(end, (chunk + 1) * INIT_CHUNK);
+    for (int64_t i = chunk * INIT_CHUNK; i < last; i++) {
+      data_[r * stride_ + c] = real(double(rng() >> 11) * scale - a);
+      if (++c == n_) {
+        c = 0;
+        r++;
+      }
+    }
   }
 }
 
-void DenseMatrix::uniform(real a, unsigned int thread, int32_t seed) {
+void DenseMatrix::uniform(
+    real a,
+    unsigned int thread,
+    int32_t seed,
+    const std::vector<int32_t>& cpus) {
+  const int64_t nchunks = (m_ * n_ + INIT_CHUNK - 1) / INIT_CHUNK;
+  const int64_t nthreads =
+      std::max(int64_t(1), std::min(int64_t(thread), nchunks));
   std::vector<std::thread> threads;
-  for (int i = 0; i < thread; i++) {
-    threads.push_back(std::thread([=]() { uniformThread(a, i, seed); }));
+  for (int64_t i = 0; i < nthreads; i++) {
+    threads.push_back(std::thread([=, &cpus]() {
+      if (!cpus.empty()) {
+        utils::pinThread(cpus[i % cpus.size()]);
+      }
+      uniformThread(a, i * nchunks / nthreads, (i + 1) * nchunks / nthreads, seed);
+    }));
   }
   for (int32_t i = 0; i < threads.size(); i++) {
     threads[i].join();
@@ -60,9 +178,7 @@ void DenseMatrix::multiplyRow(const Vector& nums, int64_t ib, int64_t ie) {
   for (auto i = ib; i < ie; i++) {
     real n = nums[i - ib];
     if (n != 0) {
-      for (auto j = 0; j < n_; j++) {
-        at(i, j) *= n;
-      }
+      kernels::get().scale(n, row(i), n_);
     }
   }
 }
@@ -84,16 +200,11 @@ void DenseMatrix::divideRow(const Vector& denoms, int64_t ib, int64_t ie) {
 
 void DenseMatrix::scalerMulRow(fasttext::real a, int64_t id) {
     assert(id <= m_);
-    for (int64_t j = 0; j < n_; j++) {
-        at(id,j) *= a;
-    }
+    kernels::get().scale(a, row(id), n_);
 }
 
 real DenseMatrix::l2NormRow(int64_t i) const {
-  auto norm = 0.0;
-  for (auto j = 0; j < n_; j++) {
-    norm += at(i, j) * at(i, j);
-  }
+  auto norm = kernels::get().sqnorm(row(i), n_);
   if (std::isnan(norm)) {
     throw EncounteredNaNError();
   }
@@ -111,10 +222,7 @@ real DenseMatrix::dotRow(const Vector& vec, int64_t i) const {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.size() == n_);
-  real d = 0.0;
-  for (int64_t j = 0; j < n_; j++) {
-    d += at(i, j) * vec[j];
-  }
+  real d = kernels::get().dot(row(i), vec.data(), n_);
   if (std::isnan(d)) {
     throw EncounteredNaNError();
   }
@@ -125,40 +233,42 @@ void DenseMatrix::addVectorToRow(const Vector& vec, int64_t i, real a) {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.size() == n_);
-  for (int64_t j = 0; j < n_; j++) {
-    data_[i * n_ + j] += a * vec[j];
-  }
+  kernels::get().axpy(a, vec.data(), row(i), n_);
 }
 
 void DenseMatrix::addRowToVector(Vector& x, int32_t i) const {
   assert(i >= 0);
   assert(i < this->size(0));
   assert(x.size() == this->size(1));
-  for (int64_t j = 0; j < n_; j++) {
-    x[j] += at(i, j);
-  }
+  kernels::get().axpy(1.0, row(i), x.data(), n_);
 }
 
 void DenseMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
   assert(i >= 0);
   assert(i < this->size(0));
   assert(x.size() == this->size(1));
-  for (int64_t j = 0; j < n_; j++) {
-    x[j] += a * at(i, j);
-  }
+  kernels::get().axpy(a, row(i), x.data(), n_);
 }
 
 void DenseMatrix::save(std::ostream& out) const {
   out.write((char*)&m_, sizeof(int64_t));
   out.write((char*)&n_, sizeof(int64_t));
-  out.write((char*)data_.data(), m_ * n_ * sizeof(real));
+  if (stride_ == n_) {
+    out.write((char*)data_, m_ * n_ * sizeof(real));
+    return;
+  }
+  for (int64_t i = 0; i < m_; i++) {
+    out.write((char*)row(i), n_ * sizeof(real));
+  }
 }
 
 void DenseMatrix::load(std::istream& in) {
   in.read((char*)&m_, sizeof(int64_t));
   in.read((char*)&n_, sizeof(int64_t));
-  data_ = std::vector<real>(m_ * n_);
-  in.read((char*)data_.data(), m_ * n_ * sizeof(real));
+  stride_ = n_;
+  allocate();
+  numa_ = numa_policy::none;
+  in.read((char*)data_, m_ * n_ * sizeof(real));
 }
 
 void DenseMatrix::dump(std::ostream& out) const {
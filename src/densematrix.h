@@ -11,12 +11,15 @@
 #include <assert.h>
 #include <cstdint>
 #include <istream>
+#include <memory>
 #include <ostream>
 #include <stdexcept>
 #include <vector>
 
+#include "args.h"
 #include "matrix.h"
 #include "real.h"
+#include "utils.h"
 
 namespace fasttext {
 
@@ -24,32 +27,87 @@ namespace fasttext {
 
     class DenseMatrix : public Matrix {
     protected:
-        std::vector<real> data_;
-        void uniformThread(real, int, int32_t);
+        // uniform() seeds one generator per chunk of this many values (one
+        // page of floats), so the result does not depend on the threads
+        static const int64_t INIT_CHUNK = 1024;
+
+        // row i starts at data_ + i * stride_; stride_ > n_ when rows are
+        // padded to ROW_ALIGNMENT, and the padding is always zero
+        int64_t stride_;
+        // data_ points into storage_, memory_, a read-only mapping or a
+        // shared segment
+        real* data_;
+        std::vector<real> storage_;
+        std::shared_ptr<utils::MappedFile> mapping_;
+        std::shared_ptr<utils::SharedMemory> segment_;
+        std::unique_ptr<utils::AnonymousMemory> memory_;
+        numa_policy numa_;
+        void uniformThread(real, int64_t, int64_t, int32_t);
+        void allocate();
 
     public:
+        // Owned storage always starts on this boundary (bytes); padded
+        // matrices also round every row up to a multiple of it.
+        static const int64_t ROW_ALIGNMENT = 64;
+        static int64_t paddedStride(int64_t n);
+
         DenseMatrix();
         explicit DenseMatrix(int64_t, int64_t);
         explicit DenseMatrix(int64_t m, int64_t n, real* dataPtr);
-        DenseMatrix(const DenseMatrix&) = default;
+        // zero m x n matrix whose pages are placed according to `numa`
+        // when uniform() first writes them; `padded` rounds up the stride
+        explicit DenseMatrix(
+                int64_t m,
+                int64_t n,
+                numa_policy numa,
+                bool padded = false);
+        // read-only view of m x n reals at byte `offset` of a mapped file
+        explicit DenseMatrix(
+                int64_t m,
+                int64_t n,
+                std::shared_ptr<utils::MappedFile> mapping,
+                int64_t offset);
+        // m x n reals at byte `offset` of a shared segment, written in
+        // place; `padded` as above
+        explicit DenseMatrix(
+                int64_t m,
+                int64_t n,
+                std::shared_ptr<utils::SharedMemory> segment,
+                int64_t offset,
+                bool padded);
+        DenseMatrix(const DenseMatrix&);
         DenseMatrix(DenseMatrix&&) noexcept;
         DenseMatrix& operator=(const DenseMatrix&) = delete;
         DenseMatrix& operator=(DenseMatrix&&) = delete;
         virtual ~DenseMatrix() noexcept override = default;
 
+        // rows are contiguous only when stride() == cols()
         inline real* data() {
-            return data_.data();
+            return data_;
         }
         inline const real* data() const {
-            return data_.data();
+            return data_;
+        }
+
+        inline real* row(int64_t i) {
+            return data_ + i * stride_;
+        }
+        inline const real* row(int64_t i) const {
+            return data_ + i * stride_;
+        }
+        inline int64_t stride() const {
+            return stride_;
+        }
+        inline bool isMapped() const {
+            return mapping_ != nullptr;
         }
 
         inline const real& at(int64_t i, int64_t j) const {
-            assert(i * n_ + j < data_.size());
-            return data_[i * n_ + j];
+            assert(i < m_ && j < n_);
+            return data_[i * stride_ + j];
         };
         inline real& at(int64_t i, int64_t j) {
-            return data_[i * n_ + j];
+            return data_[i * stride_ + j];
         };
 
         inline int64_t rows() const {
@@ -59,7 +117,14 @@ namespace fasttext {
             return n_;
         }
         void zero();
-        void uniform(real, unsigned int, int32_t);
+        // Fills with U(-a, a) on `thread` threads, each writing (and so
+        // first touching) a contiguous range; thread i runs on
+        // cpus[i % cpus.size()] when cpus is given.
+        void uniform(
+                real a,
+                unsigned int thread,
+                int32_t seed,
+                const std::vector<int32_t>& cpus = std::vector<int32_t>());
 
         void scalerMulRow(real a, int64_t id) override ;
         void multiplyRow(const Vector& nums, int64_t ib = 0, int64_t ie = -1);
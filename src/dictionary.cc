@@ -16,12 +16,20 @@
 #include <iostream>
 #include <iterator>
 #include <stdexcept>
+#include <thread>
+
+#include "spacesaving.h"
+#include "utils.h"
 
 namespace fasttext {
 
     const std::string Dictionary::EOS = "</s>";
 
     void Dictionary::readFromFile(std::istream& in) {
+        if (args_->vocabBudget > 0) {
+            readFromFileBounded(in);
+            return;
+        }
         std::string word;
         int64_t minThreshold = 1;
         while (readWord(in, word)) {
@@ -34,6 +42,10 @@ namespace fasttext {
                 threshold(minThreshold, minThreshold);
             }
         }
+        finalizeVocabulary();
+    }
+
+    void Dictionary::finalizeVocabulary() {
         threshold(args_->minCount, args_->minCountLabel);
         initTableDiscard();
         if (args_->verbose > 0) {
@@ -46,6 +58,280 @@ namespace fasttext {
         }
     }
 
+    // Counting pass for -vocabBudget: at most that many words are tracked,
+    // with Space-Saving, and the minCount cut is made once at the end.
+    // Kept counts are upper bounds; the error bounds are reported.
+    void Dictionary::readFromFileBounded(std::istream& in) {
+        // word2int_ has to keep free slots for find() to stop probing
+        if (args_->vocabBudget <= 0 || args_->vocabBudget > 0.75 * MAX_VOCAB_SIZE) {
+            throw std::invalid_argument(
+                    "-vocabBudget must be between 1 and " +
+                    std::to_string(int64_t(0.75 * MAX_VOCAB_SIZE)) + "!");
+        }
+        SpaceSaving counter(args_->vocabBudget);
+        std::string word;
+        while (readWord(in, word)) {
+            counter.add(word);
+            if (counter.total() % 1000000 == 0 && args_->verbose > 1) {
+                std::cerr << "\rRead " << counter.total() / 1000000 << "M words" << std::flush;
+            }
+        }
+        ntokens_ = counter.total();
+        int64_t minCount = std::max<int64_t>(args_->minCount, args_->minCountLabel);
+        int64_t uncertain = 0, maxError = 0;
+        words_.clear();
+        for (const auto& c : counter.counters()) {
+            if (c.count < minCount) {
+                continue;
+            }
+            entry e;
+            e.word = c.word;
+            e.count = c.count;
+            e.dictId = c.first;
+            words_.push_back(e);
+            maxError = std::max(maxError, c.error);
+            if (c.count - c.error < minCount) {
+                uncertain++;
+            }
+        }
+        size_ = words_.size();
+        if (args_->verbose > 0) {
+            std::cerr << "\rTracked " << counter.size() << " words, untracked words occur at most "
+                      << counter.minCount() << " times" << std::endl;
+            std::cerr << "Kept counts overestimate by at most " << maxError << ", "
+                      << uncertain << " kept words may be below -minCount" << std::endl;
+        }
+        finalizeVocabulary();
+    }
+
+    // Word counts of one range of the parallel pass, in an open-addressing
+    // table keyed by hash() like word2int_. The hashes are kept so the
+    // merge can shard and probe without hashing the words again.
+    struct Dictionary::RangeCounts {
+        std::vector<entry> words;
+        std::vector<uint32_t> hashes;
+        std::vector<int32_t> slots = std::vector<int32_t>(1 << 16, -1);
+        // tokens read and distinct words seen, pruned ones included
+        int64_t ntokens = 0;
+        int64_t nseen = 0;
+
+        size_t slot(const std::string& w, uint32_t h) const {
+            size_t mask = slots.size() - 1;
+            size_t i = h & mask;
+            while (slots[i] != -1 &&
+                   (hashes[slots[i]] != h || words[slots[i]].word != w)) {
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        // Adds count occurrences of w, first seen at position first.
+        void add(const std::string& w, uint32_t h, int64_t count, int64_t first) {
+            size_t i = slot(w, h);
+            if (slots[i] != -1) {
+                words[slots[i]].count += count;
+                return;
+            }
+            slots[i] = words.size();
+            words.push_back(entry{w, count, first});
+            hashes.push_back(h);
+            if (2 * words.size() > slots.size()) {
+                rehash(2 * slots.size());
+            }
+        }
+
+        // Drops the words seen fewer than t times, as threshold() does.
+        void prune(int64_t t) {
+            size_t j = 0;
+            for (size_t i = 0; i < words.size(); i++) {
+                if (words[i].count >= t) {
+                    words[j] = std::move(words[i]);
+                    hashes[j++] = hashes[i];
+                }
+            }
+            words.resize(j);
+            hashes.resize(j);
+            rehash(slots.size());
+        }
+
+        void rehash(size_t n) {
+            slots.assign(n, -1);
+            for (size_t k = 0; k < words.size(); k++) {
+                size_t i = hashes[k] & (n - 1);
+                while (slots[i] != -1) {
+                    i = (i + 1) & (n - 1);
+                }
+                slots[i] = k;
+            }
+        }
+    };
+
+    // Parallel version of readFromFile: the file is cut into line-aligned
+    // byte ranges counted by one thread each, the per-range tables are
+    // merged in first-occurrence order and threshold() finishes as usual,
+    // so words_ ends up identical to the serial pass. Each range keeps at
+    // most its share of 0.75 * MAX_VOCAB_SIZE words, pruned like add()
+    // does; past that the counts are approximate, as in the serial pass.
+    void Dictionary::readFromFile(const std::string& filename) {
+        std::ifstream ifs(filename);
+        if (!ifs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened!");
+        }
+        int32_t nthreads = args_->thread;
+        int64_t size = utils::size(ifs);
+        if (nthreads <= 1 || args_->vocabBudget > 0) {
+            utils::seek(ifs, 0);
+            readFromFile(ifs);
+            return;
+        }
+        std::vector<int64_t> bounds(nthreads + 1, size);
+        bounds[0] = 0;
+        for (int32_t i = 1; i < nthreads; i++) {
+            utils::seek(ifs, std::max(bounds[i - 1], i * size / nthreads));
+            std::string rest;
+            if (i * size / nthreads > 0 && std::getline(ifs, rest)) {
+                bounds[i] = ifs.eof() ? size : int64_t(ifs.tellg());
+            } else {
+                bounds[i] = std::max(bounds[i - 1], i * size / nthreads);
+            }
+        }
+        ifs.close();
+
+        int64_t maxWords = 0.75 * MAX_VOCAB_SIZE / nthreads;
+        std::vector<RangeCounts> counts(nthreads);
+        std::vector<std::thread> threads;
+        for (int32_t i = 0; i < nthreads; i++) {
+            threads.push_back(std::thread([&, i]() {
+                countRange(filename, bounds[i], bounds[i + 1], maxWords, counts[i]);
+            }));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        mergeCounts(counts);
+        // word2int_ is only rebuilt by threshold(), which needs the
+        // vocabulary to fit in it first.
+        int64_t minThreshold = 1;
+        while (size_ > 0.75 * MAX_VOCAB_SIZE) {
+            minThreshold++;
+            size_ = std::count_if(words_.begin(), words_.end(), [&](const entry& e) {
+                return e.count >= minThreshold;
+            });
+        }
+        if (minThreshold > 1) {
+            threshold(minThreshold, minThreshold);
+        }
+        finalizeVocabulary();
+    }
+
+    // Counts the words of [begin, end) in first-occurrence order, with the
+    // same tokenization as readWord. Ranges end right after a newline.
+    void Dictionary::countRange(
+            const std::string& filename,
+            int64_t begin,
+            int64_t end,
+            int64_t maxWords,
+            RangeCounts& counts) const {
+        std::ifstream in(filename, std::ifstream::binary);
+        utils::seek(in, begin);
+        std::string chunk, word;
+        int64_t minThreshold = 1;
+        auto count = [&](const std::string& w) {
+            counts.ntokens++;
+            size_t before = counts.words.size();
+            counts.add(w, hash(w), 1, counts.nseen);
+            if (counts.words.size() > before) {
+                counts.nseen++;
+                if (int64_t(counts.words.size()) > maxWords) {
+                    minThreshold++;
+                    counts.prune(minThreshold);
+                }
+            }
+        };
+        int64_t pos = begin;
+        while (pos < end) {
+            chunk.resize(std::min(int64_t(PARALLEL_CHUNK_SIZE), end - pos));
+            in.read(&chunk[0], chunk.size());
+            pos += chunk.size();
+            if (pos < end && chunk.back() != '\n') {
+                std::string rest;
+                std::getline(in, rest);
+                chunk += rest;
+                pos += rest.size();
+                if (!in.eof()) {
+                    chunk.push_back('\n');
+                    pos++;
+                }
+            }
+            for (char c : chunk) {
+                if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+                    c == '\f' || c == '\0') {
+                    if (!word.empty()) {
+                        count(word);
+                        word.clear();
+                    }
+                    if (c == '\n') {
+                        count(EOS);
+                    }
+                } else {
+                    word.push_back(c);
+                }
+            }
+        }
+        if (!word.empty()) {
+            count(word);
+        }
+    }
+
+    // Merges per-range counts, sharded by the high bits of the word hash
+    // across threads (the low bits pick the slot). A word's position is its
+    // first occurrence in the earliest range containing it.
+    void Dictionary::mergeCounts(const std::vector<RangeCounts>& counts) {
+        int32_t nthreads = counts.size();
+        std::vector<int64_t> offsets(nthreads + 1, 0);
+        ntokens_ = 0;
+        for (int32_t i = 0; i < nthreads; i++) {
+            offsets[i + 1] = offsets[i] + counts[i].nseen;
+            ntokens_ += counts[i].ntokens;
+        }
+        std::vector<RangeCounts> shards(nthreads);
+        std::vector<std::thread> threads;
+        for (int32_t s = 0; s < nthreads; s++) {
+            threads.push_back(std::thread([&, s]() {
+                for (int32_t i = 0; i < nthreads; i++) {
+                    const RangeCounts& range = counts[i];
+                    for (size_t k = 0; k < range.words.size(); k++) {
+                        uint32_t h = range.hashes[k];
+                        if ((uint64_t(h) * nthreads) >> 32 != uint64_t(s)) {
+                            continue;
+                        }
+                        const entry& e = range.words[k];
+                        shards[s].add(e.word, h, e.count, offsets[i] + e.dictId);
+                    }
+                }
+            }));
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        words_.clear();
+        for (auto& shard : shards) {
+            for (auto& e : shard.words) {
+                words_.push_back(std::move(e));
+            }
+        }
+        utils::parallelSort(
+                words_,
+                [](const entry& e1, const entry& e2) {
+                    return e1.dictId < e2.dictId;
+                },
+                nthreads);
+        for (size_t i = 0; i < words_.size(); i++) {
+            words_[i].dictId = i;
+        }
+        size_ = words_.size();
+    }
+
     bool Dictionary::readWord(std::istream& in, std::string& word) const {
         int c;
         std::streambuf& sb = *in.rdbuf();
@@ -89,9 +375,14 @@ namespace fasttext {
     }
 
     void Dictionary::threshold(int64_t t, int64_t tl) {
-        sort(words_.begin(), words_.end(), [](const entry& e1, const entry& e2) {
-            return e1.count > e2.count;
-        });
+        // ties keep first-occurrence order so that every sort agrees
+        utils::parallelSort(
+                words_,
+                [](const entry& e1, const entry& e2) {
+                    return e1.count > e2.count ||
+                           (e1.count == e2.count && e1.dictId < e2.dictId);
+                },
+                args_->thread);
         words_.erase(
                 remove_if(
                         words_.begin(),
@@ -113,19 +404,36 @@ namespace fasttext {
         }
     }
 
+    void Dictionary::merge(const Dictionary& other) {
+        for (const entry& e : other.words_) {
+            int32_t h = find(e.word);
+            if (word2int_[h] == -1) {
+                entry added = e;
+                added.dictId = size_;
+                words_.push_back(added);
+                word2int_[h] = size_++;
+            } else {
+                words_[word2int_[h]].count += e.count;
+            }
+        }
+        ntokens_ += other.ntokens_;
+        threshold(args_->minCount, args_->minCountLabel);
+        initTableDiscard();
+    }
+
     void Dictionary::initTableDiscard() {
         pdiscard_.resize(size_);
         for (size_t i = 0; i < size_; i++) {
             real f = real(words_[i].count) / real(ntokens_);
-            pdiscard_[i] = std::sqrt(args_->t / f) + args_->t / f;
+            double p = std::sqrt(args_->t / f) + args_->t / f;
+            pdiscard_[i] = uint32_t(std::min(p * 4294967296.0, 4294967295.0));
         }
     }
 
     int32_t Dictionary::getLine(
             std::istream& in,
             std::vector<int32_t>& words,
-            std::minstd_rand& rng) const {
-        std::uniform_real_distribution<> uniform(0, 1);
+            Rng& rng) const {
         std::string token;
         int32_t ntokens = 0;
 
@@ -139,7 +447,7 @@ namespace fasttext {
             }
 
             ntokens++;
-            if (!discard(wid, uniform(rng))) {
+            if (!discard(wid, rng.next32())) {
                 words.push_back(wid);
             }
             if (ntokens > MAX_LINE_SIZE || token == EOS) {
@@ -149,7 +457,32 @@ namespace fasttext {
         return ntokens;
     }
 
-    bool Dictionary::discard(int32_t id, real rand) const {
+    // Same line splitting as above, without subsampling and without
+    // rewinding at the end of the stream.
+    int32_t Dictionary::getLine(
+            std::istream& in,
+            std::vector<int32_t>& words) const {
+        std::string token;
+        int32_t ntokens = 0;
+
+        words.clear();
+        while (readWord(in, token)) {
+            int32_t h = find(token);
+            int32_t wid = word2int_[h];
+            if (wid < 0) {
+                continue;
+            }
+
+            ntokens++;
+            words.push_back(wid);
+            if (ntokens > MAX_LINE_SIZE || token == EOS) {
+                break;
+            }
+        }
+        return ntokens;
+    }
+
+    bool Dictionary::discard(int32_t id, uint32_t rand) const {
         assert(id >= 0);
         assert(id < nwords_);
         if (args_->model == model_name::sup) {
@@ -205,6 +538,67 @@ namespace fasttext {
         return counts;
     }
 
+    // Keeps the first n entries, i.e. the n most frequent words.
+    void Dictionary::truncate(int32_t n) {
+        if (n >= size_) {
+            return;
+        }
+        words_.resize(n);
+        size_ = n;
+        nwords_ = n;
+        std::fill(word2int_.begin(), word2int_.end(), -1);
+        for (int32_t i = 0; i < size_; i++) {
+            word2int_[find(words_[i].word)] = i;
+        }
+        initTableDiscard();
+    }
+
+    void Dictionary::save(std::ostream& out) const {
+        out.write((char*)&size_, sizeof(int32_t));
+        out.write((char*)&nwords_, sizeof(int32_t));
+        out.write((char*)&ntokens_, sizeof(int64_t));
+        for (int32_t i = 0; i < size_; i++) {
+            entry e = words_[i];
+            out.write(e.word.data(), e.word.size() * sizeof(char));
+            out.put(0);
+            out.write((char*)&(e.count), sizeof(int64_t));
+        }
+    }
+
+    void Dictionary::load(std::istream& in) {
+        words_.clear();
+        in.read((char*)&size_, sizeof(int32_t));
+        in.read((char*)&nwords_, sizeof(int32_t));
+        in.read((char*)&ntokens_, sizeof(int64_t));
+        if (!in || size_ < 0 || size_ > 0.75 * MAX_VOCAB_SIZE) {
+            throw std::invalid_argument("Invalid dictionary!");
+        }
+        words_.reserve(size_);
+        std::fill(word2int_.begin(), word2int_.end(), -1);
+        for (int32_t i = 0; i < size_; i++) {
+            char c;
+            entry e;
+            while ((c = in.get()) != 0 && in) {
+                e.word.push_back(c);
+            }
+            in.read((char*)&e.count, sizeof(int64_t));
+            e.dictId = i;
+            words_.push_back(e);
+            word2int_[find(e.word)] = i;
+        }
+        if (!in) {
+            throw std::invalid_argument("Invalid dictionary!");
+        }
+        initTableDiscard();
+    }
+
+    void Dictionary::dump(std::ostream& out) const {
+        out << words_.size() << std::endl;
+        for (auto it : words_) {
+            out << it.word << " " << it.count << std::endl;
+        }
+    }
+
     Dictionary::Dictionary(std::shared_ptr<Args> args)
             : args_(args),
               word2int_(MAX_VOCAB_SIZE, -1),
@@ -11,13 +11,13 @@
 #include <istream>
 #include <memory>
 #include <ostream>
-#include <random>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "args.h"
 #include "real.h"
+#include "rng.h"
 
 namespace fasttext {
 
@@ -35,7 +35,16 @@ class Dictionary {
   static const int32_t MAX_VOCAB_SIZE = 30000000;
   static const int32_t MAX_LINE_SIZE = 1024;
 
+  static const int64_t PARALLEL_CHUNK_SIZE = 1 << 26;
+
+  struct RangeCounts;
+
   int32_t find(const std::string&) const;
+  void countRange(const std::string&, int64_t, int64_t, int64_t, RangeCounts&)
+      const;
+  void mergeCounts(const std::vector<RangeCounts>&);
+  void finalizeVocabulary();
+  void readFromFileBounded(std::istream&);
   int32_t find(const std::string&, uint32_t h) const;
   void initTableDiscard();
   void reset(std::istream&) const;
@@ -44,7 +53,8 @@ class Dictionary {
   std::vector<int32_t> word2int_;
   std::vector<entry> words_;
 
-  std::vector<real> pdiscard_;
+  // keep probability of each word scaled to 2^32
+  std::vector<uint32_t> pdiscard_;
   int32_t size_;
   int32_t nwords_;
   int64_t ntokens_;
@@ -56,16 +66,25 @@ class Dictionary {
   int32_t nwords() const;
   int64_t ntokens() const;
   int32_t getId(const std::string&) const;
-  bool discard(int32_t, real) const;
+  bool discard(int32_t, uint32_t) const;
   std::string getWord(int32_t) const;
   uint32_t hash(const std::string& str) const;
   void add(const std::string&);
   bool readWord(std::istream&, std::string&) const;
   void readFromFile(std::istream&);
+  void readFromFile(const std::string&);
   std::vector<int64_t> getCounts(entry_type) const;
-  int32_t getLine(std::istream&, std::vector<int32_t>&, std::minstd_rand&)
-      const;
+  int32_t getLine(std::istream&, std::vector<int32_t>&, Rng&) const;
+  int32_t getLine(std::istream&, std::vector<int32_t>&) const;
   void threshold(int64_t, int64_t);
+  // Adds the counts of another vocabulary, e.g. the one of a model being
+  // trained further: shared words add up, the others are appended, and
+  // the -minCount cut and the discard table are redone.
+  void merge(const Dictionary&);
+  void truncate(int32_t);
+  void save(std::ostream&) const;
+  void load(std::istream&);
+  void dump(std::ostream&) const;
 };
 
 } // namespace fasttext
\ No newline at end of file
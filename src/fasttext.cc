@@ -10,6 +10,8 @@
 #include "loss.h"
 
 #include <algorithm>
+#include <csignal>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <numeric>
@@ -21,83 +23,460 @@
 
 namespace fasttext {
 
-    constexpr int32_t FASTTEXT_VERSION = 12; /* Version 1b */
+    // 13: matrices aligned in the file, and the args of the new training
+    // options
+    constexpr int32_t FASTTEXT_VERSION = 13;
     constexpr int32_t FASTTEXT_FILEFORMAT_MAGIC_INT32 = 793712314;
 
+    namespace {
+        volatile std::sig_atomic_t terminateRequested = 0;
+
+        extern "C" void requestTerminate(int) {
+            terminateRequested = 1;
+        }
+    } // namespace
+
     void FastText::train(const Args& args) {
         args_ = std::make_shared<Args>(args);
         dict_ = std::make_shared<Dictionary>(args_);
+        stream_ = nullptr;
         if (args_->input == "-") {
-            // manage expectations
-            throw std::invalid_argument("Cannot use stdin for training!");
+            if (args_->resume || args_->checkpoint > 0 || !args_->cache.empty()) {
+                throw std::invalid_argument(
+                        "-cache, -checkpoint and -resume need a seekable -input!");
+            }
+            if (args_->workers > 1 || !args_->shm.empty()) {
+                throw std::invalid_argument(
+                        "-workers and -shm need a seekable -input!");
+            }
+        } else {
+            std::ifstream ifs(args_->input);
+            if (!ifs.is_open()) {
+                throw std::invalid_argument(
+                        args_->input + " cannot be opened for training!");
+            }
         }
-        std::ifstream ifs(args_->input);
-        if (!ifs.is_open()) {
+        if ((args_->workers > 1 || !args_->shm.empty()) &&
+            (args_->resume || args_->checkpoint > 0)) {
             throw std::invalid_argument(
-                    args_->input + " cannot be opened for training!");
+                    "-checkpoint and -resume cannot be used with -workers or -shm!");
         }
-        dict_->readFromFile(ifs);
-        ifs.close();
-        input_ = createRandomMatrix();
-        output_ = createTrainOutputMatrix();
+        if (!args_->shm.empty() && args_->precision != precision_name::fp32) {
+            throw std::invalid_argument("-shm needs -precision fp32!");
+        }
+        shared_ = nullptr;
+        tokenCount_ = &ownTokenCount_;
+        cpus_.clear();
+        if (args_->pin != pin_policy::none) {
+            cpus_ = utils::cpuOrder(args_->pin == pin_policy::scatter);
+        }
+        progress_ = std::vector<ThreadProgress>(args_->thread);
+        startTokenCount_ = 0;
+        const std::string checkpoint = args_->output + ".ckpt";
+        if (args_->input == "-") {
+            openStdin();
+            if (!args_->pretrainedVectors.empty()) {
+                warmStart(args_->pretrainedVectors);
+            } else {
+                createTrainMatrices();
+            }
+        } else if (args_->resume && std::ifstream(checkpoint).good()) {
+            loadCheckpoint(checkpoint);
+        } else {
+            dict_->readFromFile(args_->input);
+            // before a warm start merges in the old counts: only the new
+            // corpus is trained on
+            tokenBudget_ = args_->tokenBudget > 0
+                    ? args_->tokenBudget
+                    : args_->epoch * dict_->ntokens();
+            if (!args_->pretrainedVectors.empty()) {
+                warmStart(args_->pretrainedVectors);
+            } else {
+                createTrainMatrices();
+            }
+        }
+        if (!args_->cache.empty()) {
+            loadCache();
+        }
+        quant_ = false;
+        neighbors_ = nullptr;
+        hnsw_ = nullptr;
         auto loss = createLoss(output_);
         bool normalizeGradient = (args_->model == model_name::sup);
         model_ = std::make_shared<Model>(input_, output_, loss, normalizeGradient);
+        averager_ = nullptr;
+        if (shared_) {
+            std::dynamic_pointer_cast<NegativeSamplingLoss>(loss)->shareTable(
+                    shared_->table(), args_->rank == 0);
+            tokenCount_ = &shared_->tokenCount();
+            tokenBudget_ = shared_->start(tokenBudget_);
+        } else if (args_->workers > 1) {
+            // every worker reads its own slice once per epoch
+            tokenBudget_ /= args_->workers;
+            averager_ = std::make_shared<ModelAverager>(
+                    args_,
+                    dict_->nwords(),
+                    std::vector<std::shared_ptr<Matrix>>{input_, output_});
+        }
         startThreads();
+        stream_ = nullptr;
+        averager_ = nullptr;
+        ownTokenCount_ = tokenCount_->load();
+        tokenCount_ = &ownTokenCount_;
+        shared_ = nullptr;
+    }
+
+    // Streaming mode: the first -warmup tokens are read ahead to build
+    // the vocabulary (later words outside it are skipped), then the whole
+    // stream, warm-up included, is shared out by a StreamReader and read
+    // once, whatever -epoch says. The learning rate decays over
+    // -tokenBudget tokens, or over an estimate from the size of a
+    // redirected file; with a pipe and no budget it stays constant.
+    void FastText::openStdin() {
+        std::string prefix, line;
+        int64_t tokens = 0;
+        while (tokens < args_->warmup && std::getline(std::cin, line)) {
+            bool space = true;
+            for (char c : line) {
+                bool s = c == ' ' || c == '\t' || c == '\v' || c == '\f' ||
+                        c == '\r' || c == '\0';
+                tokens += space && !s;
+                space = s;
+            }
+            tokens++;
+            prefix.append(line);
+            prefix.push_back('\n');
+        }
+        const bool ended = std::cin.eof();
+        std::istringstream warmup(prefix);
+        dict_->readFromFile(warmup);
+        tokenBudget_ = args_->tokenBudget;
+        if (tokenBudget_ <= 0 && ended) {
+            tokenBudget_ = dict_->ntokens();
+        } else if (tokenBudget_ <= 0 && utils::stdinSize() > 0 && !prefix.empty()) {
+            tokenBudget_ = double(dict_->ntokens()) / prefix.size() * utils::stdinSize();
+        }
+        if (args_->verbose > 0) {
+            if (tokenBudget_ > 0) {
+                std::cerr << "Token budget: " << tokenBudget_ << std::endl;
+            } else {
+                std::cerr << "Warning: the length of the input is unknown, "
+                          << "the learning rate stays at " << args_->lr
+                          << " (set -tokenBudget)" << std::endl;
+            }
+            if (args_->epoch > 1) {
+                std::cerr << "Warning: -epoch is ignored, stdin is read once"
+                          << std::endl;
+            }
+        }
+        stream_ = std::make_shared<StreamReader>(
+                std::cin, std::move(prefix), 2 * args_->thread);
+    }
+
+    // Warm start from a previous run. From a .bin model, its vocabulary and
+    // counts are merged into the new one and the input and output rows of
+    // every word it knows are copied. From a .vec file there are neither
+    // counts nor output rows: the vocabulary stays the new corpus's and
+    // only the input rows of its words are copied. Other rows keep their
+    // random initialization.
+    void FastText::warmStart(const std::string& filename) {
+        std::ifstream ifs(filename, std::ifstream::binary);
+        if (!ifs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened for loading!");
+        }
+        const bool model = checkModel(ifs);
+        ifs.close();
+        FastText previous;
+        if (model) {
+            previous.loadModel(filename);
+            if (previous.args_->dim != args_->dim) {
+                throw std::invalid_argument(
+                        filename + " has dimension " +
+                        std::to_string(previous.args_->dim) + ", not " +
+                        std::to_string(args_->dim) + "!");
+            }
+            dict_->merge(*previous.dict_);
+        }
+        createTrainMatrices();
+        if (shared_ && args_->rank > 0) {
+            // rank 0 copies the rows
+            return;
+        }
+
+        int64_t copied = 0;
+        Vector vec(args_->dim);
+        if (model) {
+            for (int32_t i = 0; i < dict_->nwords(); i++) {
+                const int32_t j = previous.dict_->getId(dict_->getWord(i));
+                if (j < 0) {
+                    continue;
+                }
+                vec.zero();
+                previous.input_->addRowToVector(vec, j);
+                input_->scalerMulRow(0.0, i);
+                input_->addVectorToRow(vec, i, 1.0);
+                vec.zero();
+                previous.output_->addRowToVector(vec, j);
+                output_->scalerMulRow(0.0, i);
+                output_->addVectorToRow(vec, i, 1.0);
+                copied++;
+            }
+        } else {
+            ifs.open(filename);
+            int64_t n, dim;
+            if (!(ifs >> n >> dim) || dim != args_->dim) {
+                throw std::invalid_argument(
+                        filename + " is not a .vec file of dimension " +
+                        std::to_string(args_->dim) + "!");
+            }
+            std::string word;
+            for (int64_t k = 0; k < n && ifs >> word; k++) {
+                for (int32_t j = 0; j < dim; j++) {
+                    ifs >> vec[j];
+                }
+                const int32_t i = dict_->getId(word);
+                if (i >= 0) {
+                    input_->scalerMulRow(0.0, i);
+                    input_->addVectorToRow(vec, i, 1.0);
+                    copied++;
+                }
+            }
+            if (ifs.bad() || (ifs.fail() && !ifs.eof())) {
+                throw std::invalid_argument(filename + " cannot be parsed!");
+            }
+        }
+        if (args_->verbose > 0) {
+            std::cerr << "Warm start: " << copied << " of " << dict_->nwords()
+                      << " words from " << filename << std::endl;
+        }
+    }
+
+    // With -shm the matrices are in the shared segment, where rank 0
+    // initializes them and the other ranks find them.
+    void FastText::createTrainMatrices() {
+        if (!args_->shm.empty()) {
+            shared_ = std::make_shared<SharedModel>(
+                    args_,
+                    dict_->nwords(),
+                    dict_->nwords(),
+                    NegativeSamplingLoss::tableBytes(getTargetCounts().size()));
+            if (args_->rank > 0) {
+                input_ = shared_->input();
+                output_ = shared_->output();
+                return;
+            }
+        }
+        input_ = createRandomMatrix();
+        output_ = createTrainOutputMatrix();
+    }
+
+    void FastText::loadCache() {
+        uint64_t corpusHash = CorpusCache::hashCorpus(args_->input);
+        uint64_t vocabHash = CorpusCache::hashVocabulary(*dict_);
+        try {
+            cache_ = std::make_shared<CorpusCache>(args_->cache);
+        } catch (const std::invalid_argument&) {
+            cache_ = nullptr;
+        }
+        if (cache_ && cache_->matches(corpusHash, vocabHash)) {
+            if (args_->verbose > 0) {
+                std::cerr << "Reusing id cache " << args_->cache << std::endl;
+            }
+            return;
+        }
+        cache_ = nullptr;
+        std::ifstream ifs(args_->input);
+        CorpusCache::build(
+                args_->cache, ifs, *dict_, corpusHash, vocabHash, args_->cacheVarint);
+        cache_ = std::make_shared<CorpusCache>(args_->cache);
+        if (args_->verbose > 0) {
+            std::cerr << "Wrote id cache " << args_->cache << " ("
+                      << cache_->nlines() << " lines)" << std::endl;
+        }
     }
 
     void FastText::startThreads() {
         start_ = std::chrono::steady_clock::now();
-        tokenCount_ = 0;
+        if (!shared_) {
+            *tokenCount_ = startTokenCount_;
+        }
         lossFirst_ = 0;lossSecond_ = 0;
         trainException_ = nullptr;
+        stop_ = false;
+        checkpointPid_ = -1;
+        const std::string checkpoint = args_->output + ".ckpt";
+        const bool checkpointing = args_->checkpoint > 0;
+        void (*previousHandler)(int) = SIG_DFL;
+        if (checkpointing) {
+            terminateRequested = 0;
+            previousHandler = std::signal(SIGTERM, requestTerminate);
+        }
+        auto lastCheckpoint = start_;
+        int64_t nextSync = *tokenCount_ + args_->syncTokens;
         std::vector<std::thread> threads;
         for (int32_t i = 0; i < args_->thread; i++) {
             threads.push_back(std::thread([=]() { trainThread(i); }));
         }
-        const int64_t ntokens = dict_->ntokens();
         // Same condition as trainThread
-        while (keepTraining(ntokens)) {
+        while (keepTraining() && !(stream_ && stream_->exhausted())) {
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (terminateRequested) {
+                stop_ = true;
+            }
+            if (shared_ && trainException_) {
+                shared_->stop();
+            }
+            if (checkpointing && checkpointPid_ > 0 &&
+                utils::reapChild(checkpointPid_, false) != 0) {
+                checkpointPid_ = -1;
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (checkpointing && checkpointPid_ < 0 && !stop_ &&
+                utils::getDuration(lastCheckpoint, now) >= args_->checkpoint) {
+                checkpointPid_ = utils::forkCall(
+                        [&]() { return saveCheckpoint(checkpoint); });
+                lastCheckpoint = now;
+            }
+            // the threads keep training while the rows are exchanged
+            if (averager_ && !trainException_ && *tokenCount_ >= nextSync) {
+                try {
+                    averager_->round(false);
+                } catch (const std::exception&) {
+                    trainException_ = std::current_exception();
+                }
+                nextSync = *tokenCount_ + args_->syncTokens;
+            }
             if (lossFirst_ >= 0 && args_->verbose > 1) {
-                real progress = real(tokenCount_) / (args_->epoch * ntokens);
+                real progress = trainingProgress();
                 std::cerr << "\r";
                 printInfo(progress, lossFirst_, lossSecond_, std::cerr);
             }
         }
+        if (stream_) {
+            // threads waiting for a silent pipe would not see stop_
+            stream_->stop();
+        }
         for (int32_t i = 0; i < args_->thread; i++) {
             threads[i].join();
         }
+        if (checkpointPid_ > 0) {
+            utils::reapChild(checkpointPid_, true);
+            checkpointPid_ = -1;
+        }
+        if (checkpointing) {
+            std::signal(SIGTERM, previousHandler);
+        }
+        if (shared_) {
+            if (trainException_) {
+                shared_->stop();
+            }
+            // the model is only complete once everybody is done with it
+            shared_->finish();
+            if (!trainException_ && shared_->stopped()) {
+                throw std::runtime_error("Another worker stopped training");
+            }
+        }
+        // until every worker is done, and so holds the same model
+        if (averager_ && !trainException_) {
+            while (averager_->round(true)) {
+            }
+        }
         if (trainException_) {
             std::exception_ptr exception = trainException_;
             trainException_ = nullptr;
             std::rethrow_exception(exception);
         }
+        if (stop_) {
+            // the threads are done, so this one is exact
+            if (!saveCheckpoint(checkpoint)) {
+                throw std::runtime_error(checkpoint + " cannot be written!");
+            }
+            if (args_->verbose > 0) {
+                std::cerr << std::endl;
+            }
+            throw TrainingInterrupted(checkpoint);
+        }
         if (args_->verbose > 0) {
             std::cerr << "\r";
             printInfo(1.0, lossFirst_, lossSecond_, std::cerr);
             std::cerr << std::endl;
         }
+        if (averager_ && args_->verbose > 1) {
+            std::cerr << "Averaged " << averager_->rounds() << " times, sent "
+                      << averager_->bytesSent() / 1024 << " KB" << std::endl;
+        }
     }
 
     void FastText::trainThread(int32_t threadId) {
-        std::ifstream ifs(args_->input);
-        utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
+        if (!cpus_.empty()) {
+            utils::pinThread(cpus_[threadId % cpus_.size()]);
+        }
+        // this thread's place among the threads of all workers
+        const int32_t slice = args_->rank * args_->thread + threadId;
+        const int32_t nslices = args_->workers * args_->thread;
+        Model::State state(args_->dim, slice, args_->seed);
+        const ThreadProgress& resumed = progress_[threadId];
+        const int64_t position = resumed.position[resumed.current];
+        if (position >= 0) {
+            state.rng = resumed.rng[resumed.current];
+        }
 
-        Model::State state(args_->dim, args_->dim, threadId, threadId + args_->seed);
+        std::ifstream ifs;
+        std::istringstream block;
+        std::string text;
+        bool blockDone = true;
+        int64_t cacheLine = 0;
+        if (cache_) {
+            cacheLine = position >= 0
+                    ? position
+                    : cache_->startLine(slice, nslices);
+        } else if (!stream_) {
+            ifs.open(args_->input);
+            utils::seek(ifs, position >= 0
+                    ? position
+                    : slice * utils::size(ifs) / nslices);
+        }
+        const bool checkpointing = args_->checkpoint > 0;
+        auto publish = [&]() {
+            if (cache_) {
+                publishProgress(threadId, state.rng, cacheLine);
+            } else {
+                // getLine rewinds a stream that hit the end
+                publishProgress(
+                        threadId, state.rng, ifs.eof() ? 0 : int64_t(ifs.tellg()));
+            }
+        };
 
-        const int64_t ntokens = dict_->ntokens();
         int64_t localTokenCount = 0;
         std::vector<int32_t> line, labels;
+        model_->syncHotRows(state);
         try {
-            while (keepTraining(ntokens)) {
-                real progress = real(tokenCount_) / (args_->epoch * ntokens);
+            while (keepTraining()) {
+                real progress = trainingProgress();
                 real lr = args_->lr * (1.0 - progress);
-                localTokenCount += dict_->getLine(ifs, line, state.rng);
+                if (cache_) {
+                    localTokenCount += cache_->getLine(cacheLine, line, *dict_, state.rng);
+                } else if (stream_) {
+                    if (blockDone) {
+                        if (!stream_->next(text)) {
+                            break;
+                        }
+                        block.str(text);
+                        block.clear();
+                    }
+                    // getLine would rewind a block it has finished
+                    localTokenCount += dict_->getLine(block, line, state.rng);
+                    blockDone = block.eof();
+                } else {
+                    localTokenCount += dict_->getLine(ifs, line, state.rng);
+                }
                 skipgram(state, lr, line);
                 if (localTokenCount > args_->lrUpdateRate) {
-                    tokenCount_ += localTokenCount;
+                    *tokenCount_ += localTokenCount;
                     localTokenCount = 0;
+                    if (checkpointing) {
+                        publish();
+                    }
                     if (threadId == 0 && args_->verbose > 1) {
                         lossFirst_ = state.getFirstLoss();
                         lossSecond_ = state.getSecondLoss();
@@ -107,6 +486,11 @@ namespace fasttext {
         } catch (DenseMatrix::EncounteredNaNError&) {
             trainException_ = std::current_exception();
         }
+        model_->syncHotRows(state);
+        if (checkpointing) {
+            *tokenCount_ += localTokenCount;
+            publish();
+        }
         if (threadId == 0) {
             lossFirst_ = state.getFirstLoss();
             lossSecond_ = state.getSecondLoss();
@@ -114,18 +498,174 @@ namespace fasttext {
         ifs.close();
     }
 
-    bool FastText::keepTraining(const int64_t ntokens) const {
-        return tokenCount_ < args_->epoch * ntokens && !trainException_;
+    void FastText::publishProgress(
+            int32_t threadId,
+            const Rng& rng,
+            int64_t position) {
+        ThreadProgress& progress = progress_[threadId];
+        const int32_t next = 1 - progress.current.load(std::memory_order_relaxed);
+        progress.rng[next] = rng;
+        progress.position[next] = position;
+        progress.current.store(next, std::memory_order_release);
+    }
+
+    // Checkpoint layout: the model header, args and dictionary, a hash of
+    // the input, tokenCount_ and tokenBudget_, the progress of each thread
+    // and both matrices
+    // as in a model file. Written next to the target and renamed over it,
+    // so an interrupted write leaves the previous checkpoint intact.
+    bool FastText::saveCheckpoint(const std::string& filename) const {
+        const std::string tmp = filename + ".tmp";
+        std::ofstream ofs(tmp, std::ofstream::binary);
+        if (!ofs.is_open()) {
+            return false;
+        }
+        signModel(ofs);
+        args_->save(ofs);
+        dict_->save(ofs);
+        const uint64_t corpusHash = CorpusCache::hashCorpus(args_->input);
+        const int64_t tokenCount = *tokenCount_;
+        const int32_t nthreads = progress_.size();
+        ofs.write((char*)&corpusHash, sizeof(uint64_t));
+        ofs.write((char*)&tokenCount, sizeof(int64_t));
+        ofs.write((char*)&tokenBudget_, sizeof(int64_t));
+        ofs.write((char*)&nthreads, sizeof(int32_t));
+        for (const ThreadProgress& progress : progress_) {
+            const int32_t current = progress.current.load(std::memory_order_acquire);
+            ofs.write((char*)&progress.rng[current], sizeof(Rng));
+            ofs.write((char*)&progress.position[current], sizeof(int64_t));
+        }
+        saveMatrix(ofs, *input_);
+        saveMatrix(ofs, *output_);
+        ofs.close();
+        return ofs && std::rename(tmp.c_str(), filename.c_str()) == 0;
+    }
+
+    void FastText::loadCheckpoint(const std::string& filename) {
+        std::ifstream ifs(filename, std::ifstream::binary);
+        if (!ifs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened for loading!");
+        }
+        if (!checkModel(ifs)) {
+            throw std::invalid_argument(filename + " has wrong file format!");
+        }
+        Args saved;
+        saved.load(ifs);
+        if (saved.dim != args_->dim || saved.model != args_->model ||
+            saved.loss != args_->loss || saved.bucket != args_->bucket ||
+            saved.minn != args_->minn || saved.maxn != args_->maxn ||
+            saved.wordNgrams != args_->wordNgrams) {
+            throw std::invalid_argument(
+                    filename + " was made with a different model configuration!");
+        }
+        dict_->load(ifs);
+        uint64_t corpusHash;
+        int64_t tokenCount;
+        int32_t nthreads;
+        ifs.read((char*)&corpusHash, sizeof(uint64_t));
+        ifs.read((char*)&tokenCount, sizeof(int64_t));
+        ifs.read((char*)&tokenBudget_, sizeof(int64_t));
+        ifs.read((char*)&nthreads, sizeof(int32_t));
+        if (!ifs || nthreads < 0) {
+            throw std::invalid_argument(filename + " is corrupted!");
+        }
+        if (corpusHash != CorpusCache::hashCorpus(args_->input)) {
+            throw std::invalid_argument(
+                    args_->input + " changed since " + filename + " was written!");
+        }
+        for (int32_t i = 0; i < nthreads; i++) {
+            Rng rng;
+            int64_t position;
+            ifs.read((char*)&rng, sizeof(Rng));
+            ifs.read((char*)&position, sizeof(int64_t));
+            // positions are per thread, so they only carry over to the
+            // same thread count
+            if (nthreads == args_->thread) {
+                publishProgress(i, rng, position);
+            }
+        }
+        if (nthreads != args_->thread && args_->verbose > 0) {
+            std::cerr << "Warning: " << filename << " was written with "
+                      << nthreads << " threads, the input is read again from "
+                      << "the default positions." << std::endl;
+        }
+        input_ = loadTrainMatrix(ifs);
+        output_ = loadTrainMatrix(ifs);
+        startTokenCount_ = tokenCount;
+        if (args_->verbose > 0) {
+            std::cerr << "Resuming from " << filename << " at "
+                      << tokenCount << " tokens" << std::endl;
+        }
+    }
+
+    // Reads a matrix section of a model file into a matrix laid out for
+    // training (-precision, -numa, -padRows).
+    std::shared_ptr<Matrix> FastText::loadTrainMatrix(std::istream& in) const {
+        int64_t m, n, offset;
+        in.read((char*)&m, sizeof(int64_t));
+        in.read((char*)&n, sizeof(int64_t));
+        in.read((char*)&offset, sizeof(int64_t));
+        if (!in || m != dict_->nwords() || n != args_->dim) {
+            throw std::invalid_argument("Invalid matrix section!");
+        }
+        std::shared_ptr<Matrix> matrix;
+        if (args_->precision != precision_name::fp32) {
+            matrix = std::make_shared<HalfMatrix>(
+                    m, n, args_->precision, args_->fullRows);
+        } else {
+            matrix = std::make_shared<DenseMatrix>(
+                    m, n, args_->numa, args_->padRows);
+        }
+        // both start zeroed, so adding a row stores it exactly
+        in.seekg(offset);
+        Vector vec(n);
+        for (int64_t i = 0; i < m; i++) {
+            in.read((char*)vec.data(), n * sizeof(real));
+            matrix->addVectorToRow(vec, i, 1.0);
+        }
+        if (!in) {
+            throw std::invalid_argument("Invalid matrix section!");
+        }
+        return matrix;
+    }
+
+    // Stream threads stop when the reader runs dry instead.
+    bool FastText::keepTraining() const {
+        if (trainException_ || stop_ || (shared_ && shared_->stopped())) {
+            return false;
+        }
+        return stream_ || *tokenCount_ < tokenBudget_;
+    }
+
+    // Fraction of the token budget used. A stream may outlast an estimated
+    // budget, so its progress stops at MAX_STREAM_PROGRESS to keep the
+    // learning rate above zero; an unknown budget keeps it constant.
+    real FastText::trainingProgress() const {
+        if (tokenBudget_ <= 0) {
+            return 0.0;
+        }
+        real progress = real(*tokenCount_) / tokenBudget_;
+        return stream_ ? std::min(progress, real(MAX_STREAM_PROGRESS)) : progress;
     }
 
     void FastText::skipgram(
             Model::State& state,
             real lr,
             const std::vector<int32_t>& line) {
-        std::uniform_int_distribution<> uniform(1, args_->ws);
-        std::uniform_int_distribution<> secOutIdUniform(-args_->ws, args_->ws);
         for (int32_t w = 0; w < line.size(); w++) {
-            int32_t boundary = uniform(state.rng), secC, secSampTime;
+            int32_t boundary = 1 + state.rng.uniform(args_->ws), secC, secSampTime;
+            if (args_->sharedNeg) {
+                state.windowInputs.clear();
+                for (int32_t c = -boundary; c <= boundary; c++) {
+                    if (c != 0 && w + c >= 0 && w + c < int32_t(line.size())) {
+                        state.windowInputs.push_back(line[w + c]);
+                    }
+                }
+                if (!state.windowInputs.empty()) {
+                    model_->updateWindow(state.windowInputs, line[w], lr, state);
+                }
+                continue;
+            }
             const int32_t & inDictId = line[w]; state.inId = inDictId;
             for (int32_t c = -boundary; c <= boundary; c++) {
                 if (c != 0 && w + c >= 0 && w + c < line.size()) {
@@ -142,16 +682,26 @@ namespace fasttext {
 
     void FastText::printInfo(real progress, real lossFirst, real lossSecond, std::ostream& log_stream) {
         double t = utils::getDuration(start_, std::chrono::steady_clock::now());
-        double lr = args_->lr * (1.0 - progress);
+        // without a token budget (stdin) the learning rate is constant
+        double lr = tokenBudget_ > 0 ? args_->lr * (1.0 - progress) : args_->lr;
         double wst = 0;
 
         int64_t eta = 2592000; // Default to one month in seconds (720 * 3600)
 
-        if (progress > 0 && t >= 0) {
-            progress = progress * 100;
-            eta = t * (100 - progress) / progress;
-            wst = double(tokenCount_) / t / args_->thread;
+        if (t > 0) {
+            // a resumed run only counts what it trained itself, and -shm
+            // counts the threads of every worker
+            const int32_t nthreads =
+                    shared_ ? args_->workers * args_->thread : args_->thread;
+            wst = double(*tokenCount_ - startTokenCount_) / t / nthreads;
+        }
+        const double done = tokenBudget_ > 0
+                ? progress - double(startTokenCount_) / tokenBudget_
+                : 0.0;
+        if (done > 0 && t >= 0) {
+            eta = t * (1.0 - progress) / done;
         }
+        progress = progress * 100;
 
         log_stream << std::fixed;
         log_stream << "Progress: ";
@@ -165,63 +715,533 @@ namespace fasttext {
     }
 
     std::shared_ptr<Matrix> FastText::createRandomMatrix() const {
-        std::shared_ptr<DenseMatrix> input = std::make_shared<DenseMatrix>(
-                dict_->nwords(), args_->dim);
-        input->uniform(1.0 / args_->dim, args_->thread, args_->seed);
+        if (args_->precision != precision_name::fp32) {
+            std::shared_ptr<HalfMatrix> input = std::make_shared<HalfMatrix>(
+                    dict_->nwords(), args_->dim, args_->precision, args_->fullRows);
+            input->uniform(1.0 / args_->dim, args_->thread, args_->seed);
+            return input;
+        }
+        std::shared_ptr<DenseMatrix> input = shared_
+                ? shared_->input()
+                : std::make_shared<DenseMatrix>(
+                        dict_->nwords(), args_->dim, args_->numa, args_->padRows);
+        input->uniform(1.0 / args_->dim, args_->thread, args_->seed, cpus_);
 
         return input;
     }
 
     std::shared_ptr<Matrix> FastText::createTrainOutputMatrix() const {
         int64_t m = dict_->nwords();
-        std::shared_ptr<DenseMatrix> output =
-                std::make_shared<DenseMatrix>(m, args_->dim);
+        if (args_->precision != precision_name::fp32) {
+            std::shared_ptr<HalfMatrix> output = std::make_shared<HalfMatrix>(
+                    m, args_->dim, args_->precision, args_->fullRows);
+            output->uniform(1.0 / args_->dim, args_->thread, args_->seed);
+            return output;
+        }
+        std::shared_ptr<DenseMatrix> output = shared_
+                ? shared_->output()
+                : std::make_shared<DenseMatrix>(
+                        m, args_->dim, args_->numa, args_->padRows);
 //        output->zero();
-        output->uniform(1.0 / args_->dim, args_->thread, args_->seed);
+        output->uniform(1.0 / args_->dim, args_->thread, args_->seed, cpus_);
         return output;
     }
 
-    void FastText::getWordVector(Vector& vec, const std::string& word) const {
-        const int32_t & dictId = dict_->getId(word);
-        vec.zero();
-        addInputVector(vec, dictId);
+    void FastText::signModel(std::ostream& out) const {
+        const int32_t magic = FASTTEXT_FILEFORMAT_MAGIC_INT32;
+        const int32_t version = FASTTEXT_VERSION;
+        out.write((char*)&(magic), sizeof(int32_t));
+        out.write((char*)&(version), sizeof(int32_t));
     }
 
-    void FastText::saveVectors(const std::string& filename) {
+    bool FastText::checkModel(std::istream& in) {
+        int32_t magic;
+        in.read((char*)&(magic), sizeof(int32_t));
+        if (magic != FASTTEXT_FILEFORMAT_MAGIC_INT32) {
+            return false;
+        }
+        int32_t version;
+        in.read((char*)&(version), sizeof(int32_t));
+        if (version != FASTTEXT_VERSION) {
+            // not another format: tell it apart from a .vec in warmStart
+            throw std::invalid_argument(
+                    "Model file version " + std::to_string(version) +
+                    " is not supported, this build reads version " +
+                    std::to_string(FASTTEXT_VERSION) + "!");
+        }
+        return true;
+    }
+
+    // Matrix sections: rows, cols and the file offset of the data, which is
+    // padded to MATRIX_ALIGNMENT so that it can be mapped in place.
+    // Quantized matrices are written in their own format; half precision
+    // ones are widened, so the file is the same as for fp32 training.
+    void FastText::saveMatrix(std::ostream& out, const Matrix& matrix) const {
+        const QuantMatrix* quant = dynamic_cast<const QuantMatrix*>(&matrix);
+        if (quant) {
+            quant->save(out);
+            return;
+        }
+        const DenseMatrix* dense = dynamic_cast<const DenseMatrix*>(&matrix);
+        int64_t m = matrix.size(0), n = matrix.size(1);
+        int64_t pos = int64_t(out.tellp()) + 3 * sizeof(int64_t);
+        int64_t offset = (pos + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+        out.write((char*)&m, sizeof(int64_t));
+        out.write((char*)&n, sizeof(int64_t));
+        out.write((char*)&offset, sizeof(int64_t));
+        std::vector<char> padding(offset - pos, 0);
+        out.write(padding.data(), padding.size());
+        Vector vec(n);
+        for (int64_t i = 0; i < m; i++) {
+            const real* row = vec.data();
+            if (dense) {
+                row = dense->row(i);
+            } else {
+                vec.zero();
+                matrix.addRowToVector(vec, i);
+            }
+            out.write((char*)row, n * sizeof(real));
+        }
+    }
+
+    std::shared_ptr<Matrix> FastText::loadMatrix(
+            std::istream& in,
+            std::shared_ptr<utils::MappedFile> mapping,
+            bool quant) const {
+        if (quant) {
+            std::shared_ptr<QuantMatrix> matrix = std::make_shared<QuantMatrix>();
+            matrix->load(in);
+            return matrix;
+        }
+        int64_t m, n, offset;
+        in.read((char*)&m, sizeof(int64_t));
+        in.read((char*)&n, sizeof(int64_t));
+        in.read((char*)&offset, sizeof(int64_t));
+        if (!in || m < 0 || n < 0) {
+            throw std::invalid_argument("Invalid matrix section!");
+        }
+        std::shared_ptr<DenseMatrix> matrix;
+        if (mapping) {
+            matrix = std::make_shared<DenseMatrix>(m, n, mapping, offset);
+        } else {
+            matrix = std::make_shared<DenseMatrix>(m, n);
+            in.seekg(offset);
+            in.read((char*)matrix->data(), m * n * sizeof(real));
+        }
+        in.seekg(offset + m * n * sizeof(real));
+        if (!in) {
+            throw std::invalid_argument("Invalid matrix section!");
+        }
+        return matrix;
+    }
+
+    void FastText::saveModel(const std::string& filename) {
         if (!input_ || !output_) {
             throw std::runtime_error("Model never trained");
         }
-        std::ofstream ofs(filename);
+        std::ofstream ofs(filename, std::ofstream::binary);
         if (!ofs.is_open()) {
-            throw std::invalid_argument(
-                    filename + " cannot be opened for saving vectors!");
+            throw std::invalid_argument(filename + " cannot be opened for saving!");
+        }
+        signModel(ofs);
+        args_->save(ofs);
+        dict_->save(ofs);
+        ofs.write((char*)&(quant_), sizeof(bool));
+        saveMatrix(ofs, *input_);
+        ofs.write((char*)&(args_->qout), sizeof(bool));
+        saveMatrix(ofs, *output_);
+        ofs.close();
+        if (!ofs) {
+            throw std::runtime_error(filename + " cannot be written!");
+        }
+    }
+
+    // With mmap the matrices are read-only views of the file.
+    void FastText::loadModel(const std::string& filename, bool mmap) {
+        std::ifstream ifs(filename, std::ifstream::binary);
+        if (!ifs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened for loading!");
+        }
+        if (!checkModel(ifs)) {
+            throw std::invalid_argument(filename + " has wrong file format!");
+        }
+        args_ = std::make_shared<Args>();
+        args_->load(ifs);
+        dict_ = std::make_shared<Dictionary>(args_);
+        dict_->load(ifs);
+        std::shared_ptr<utils::MappedFile> mapping;
+        if (mmap) {
+            mapping = std::make_shared<utils::MappedFile>(filename);
+        }
+        ifs.read((char*)&(quant_), sizeof(bool));
+        input_ = loadMatrix(ifs, mapping, quant_);
+        ifs.read((char*)&(args_->qout), sizeof(bool));
+        output_ = loadMatrix(ifs, mapping, args_->qout);
+        model_ = nullptr;
+        cache_ = nullptr;
+        neighbors_ = nullptr;
+        hnsw_ = nullptr;
+        // the thread count is not part of the model; queries use all cores
+        args_->thread = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::shared_ptr<const DenseMatrix> FastText::getDenseInput() const {
+        if (!input_) {
+            throw std::runtime_error("Model never trained");
         }
-        ofs << dict_->nwords() << " " << args_->dim << std::endl;
+        std::shared_ptr<const DenseMatrix> input = toDense(input_);
+        if (!input) {
+            throw std::invalid_argument("Nearest neighbours need a dense input matrix!");
+        }
+        return input;
+    }
+
+    // Dense matrices are returned as is and half precision ones widened
+    // into a copy; quantized ones give nullptr.
+    std::shared_ptr<const DenseMatrix> FastText::toDense(
+            std::shared_ptr<const Matrix> matrix) {
+        std::shared_ptr<const DenseMatrix> dense =
+                std::dynamic_pointer_cast<const DenseMatrix>(matrix);
+        if (dense || !std::dynamic_pointer_cast<const HalfMatrix>(matrix)) {
+            return dense;
+        }
+        const int64_t m = matrix->size(0), n = matrix->size(1);
+        std::shared_ptr<DenseMatrix> copy = std::make_shared<DenseMatrix>(m, n);
+        Vector vec(n);
+        for (int64_t i = 0; i < m; i++) {
+            vec.zero();
+            matrix->addRowToVector(vec, i);
+            std::copy(vec.data(), vec.data() + n, copy->row(i));
+        }
+        return copy;
+    }
+
+    std::shared_ptr<NearestNeighbors> FastText::getNeighbors(bool int8) {
+        if (!neighbors_ && quant_) {
+            neighbors_ = std::make_shared<NearestNeighbors>(
+                    std::dynamic_pointer_cast<const QuantMatrix>(input_), args_->thread);
+        }
+        if (!neighbors_) {
+            neighbors_ = std::make_shared<NearestNeighbors>(getDenseInput(), args_->thread);
+        }
+        if (int8 && !neighbors_->hasInt8()) {
+            neighbors_->buildInt8();
+        }
+        return neighbors_;
+    }
+
+    std::vector<std::pair<real, std::string>> FastText::getNN(
+            const std::string& word, int32_t k) {
+        return getNN(std::vector<std::string>(1, word), k)[0];
+    }
+
+    std::vector<std::vector<std::pair<real, std::string>>> FastText::getNN(
+            const std::vector<std::string>& words, int32_t k, bool int8) {
+        std::shared_ptr<NearestNeighbors> neighbors = getNeighbors(int8);
+        std::vector<std::vector<std::pair<real, std::string>>> results(words.size());
+        std::vector<int32_t> known;
+        for (size_t i = 0; i < words.size(); i++) {
+            if (dict_->getId(words[i]) >= 0) {
+                known.push_back(i);
+            }
+        }
+        if (known.empty()) {
+            return results;
+        }
+        DenseMatrix queries(known.size(), args_->dim);
+        std::vector<std::vector<int32_t>> exclude(known.size());
         Vector vec(args_->dim);
-        for (int32_t i = 0; i < dict_->nwords(); i++) {
-            std::string word = dict_->getWord(i);
-            getWordVector(vec, word);
-            ofs << word << " " << vec << std::endl;
+        for (size_t q = 0; q < known.size(); q++) {
+            int32_t id = dict_->getId(words[known[q]]);
+            vec.zero();
+            addInputVector(vec, id);
+            std::copy(vec.data(), vec.data() + args_->dim, queries.row(q));
+            exclude[q].push_back(id);
         }
-        ofs.close();
+        auto found = neighbors->search(queries, k, exclude, int8 ? PRESCORE_FACTOR * k : 0);
+        for (size_t q = 0; q < known.size(); q++) {
+            for (const auto& neighbor : found[q]) {
+                results[known[q]].push_back(
+                        std::make_pair(neighbor.first, dict_->getWord(neighbor.second)));
+            }
+        }
+        return results;
     }
 
-    void FastText::saveOutput(const std::string& filename) {
-        std::ofstream ofs(filename);
-        if (!ofs.is_open()) {
-            throw std::invalid_argument(
-                    filename + " cannot be opened for saving vectors!");
+    std::vector<std::vector<std::pair<real, std::string>>> FastText::getAnalogies(
+            const std::vector<std::vector<std::string>>& questions,
+            int32_t k,
+            bool int8) {
+        std::shared_ptr<NearestNeighbors> neighbors = getNeighbors(int8);
+        std::vector<std::vector<std::pair<real, std::string>>> results(questions.size());
+        std::vector<int32_t> known;
+        std::vector<std::vector<int32_t>> exclude;
+        for (size_t i = 0; i < questions.size(); i++) {
+            if (questions[i].size() != 3) {
+                throw std::invalid_argument("An analogy question needs three words!");
+            }
+            std::vector<int32_t> ids;
+            for (const std::string& word : questions[i]) {
+                ids.push_back(dict_->getId(word));
+            }
+            if (*std::min_element(ids.begin(), ids.end()) >= 0) {
+                known.push_back(i);
+                exclude.push_back(ids);
+            }
         }
-        int32_t n = dict_->nwords();
-        ofs << n << " " << args_->dim << std::endl;
+        if (known.empty()) {
+            return results;
+        }
+        DenseMatrix queries(known.size(), args_->dim);
         Vector vec(args_->dim);
-        for (int32_t i = 0; i < n; i++) {
-            std::string word = dict_->getWord(i);
+        for (size_t q = 0; q < known.size(); q++) {
             vec.zero();
-            vec.addRow(*output_, i);
-            ofs << word << " " << vec << std::endl;
+            vec.addRow(*input_, exclude[q][1]);
+            vec.addRow(*input_, exclude[q][0], -1.0);
+            vec.addRow(*input_, exclude[q][2]);
+            std::copy(vec.data(), vec.data() + args_->dim, queries.row(q));
+        }
+        auto found = neighbors->search(queries, k, exclude, int8 ? PRESCORE_FACTOR * k : 0);
+        for (size_t q = 0; q < known.size(); q++) {
+            for (const auto& neighbor : found[q]) {
+                results[known[q]].push_back(
+                        std::make_pair(neighbor.first, dict_->getWord(neighbor.second)));
+            }
+        }
+        return results;
+    }
+
+    std::vector<std::vector<std::pair<real, std::string>>> FastText::getApproxNN(
+            const std::vector<std::string>& words, int32_t k, int32_t ef) const {
+        if (!hnsw_) {
+            throw std::runtime_error("No HNSW index built or loaded");
+        }
+        std::shared_ptr<const DenseMatrix> input = getDenseInput();
+        std::vector<std::vector<std::pair<real, std::string>>> results(words.size());
+        const int32_t nthreads =
+                std::max<int64_t>(1, std::min<int64_t>(args_->thread, words.size()));
+        std::vector<std::thread> threads;
+        for (int32_t t = 0; t < nthreads; t++) {
+            threads.push_back(std::thread([&, t]() {
+                Hnsw::Scratch scratch;
+                for (size_t i = t; i < words.size(); i += nthreads) {
+                    int32_t id = dict_->getId(words[i]);
+                    if (id < 0) {
+                        continue;
+                    }
+                    for (const auto& neighbor :
+                         hnsw_->search(input->row(id), k, ef, scratch, id)) {
+                        results[i].push_back(std::make_pair(
+                                neighbor.first, dict_->getWord(neighbor.second)));
+                    }
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
         }
+        return results;
+    }
+
+    void FastText::buildIndex(int32_t M, int32_t efConstruction) {
+        hnsw_ = std::make_shared<Hnsw>(getDenseInput(), M, efConstruction);
+        hnsw_->build(args_->thread, args_->seed);
+    }
+
+    void FastText::saveIndex(const std::string& filename) const {
+        if (!hnsw_) {
+            throw std::runtime_error("No HNSW index built or loaded");
+        }
+        std::ofstream ofs(filename, std::ofstream::binary);
+        if (!ofs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened for saving!");
+        }
+        hnsw_->save(ofs);
         ofs.close();
+        if (!ofs) {
+            throw std::runtime_error(filename + " cannot be written!");
+        }
+    }
+
+    void FastText::loadIndex(const std::string& filename) {
+        std::ifstream ifs(filename, std::ifstream::binary);
+        if (!ifs.is_open()) {
+            throw std::invalid_argument(filename + " cannot be opened for loading!");
+        }
+        std::shared_ptr<Hnsw> hnsw = std::make_shared<Hnsw>(getDenseInput(), 0, 0);
+        hnsw->load(ifs);
+        hnsw_ = hnsw;
+    }
+
+    void FastText::quantize(const Args& qargs) {
+        if (!input_ || !output_) {
+            throw std::runtime_error("Model never trained");
+        }
+        if (quant_) {
+            throw std::invalid_argument("The model is already quantized!");
+        }
+        // -dsub is parsed unsigned, so a negative value is out of range too
+        if (qargs.dsub < 1 || qargs.dsub > size_t(args_->dim)) {
+            throw std::invalid_argument(
+                    "-dsub must be between 1 and the dimension of the model (" +
+                    std::to_string(args_->dim) + ")!");
+        }
+        args_->qout = qargs.qout;
+        args_->qnorm = qargs.qnorm;
+        args_->cutoff = qargs.cutoff;
+        args_->dsub = qargs.dsub;
+        args_->thread = qargs.thread;
+        args_->verbose = qargs.verbose;
+        if (qargs.retrain) {
+            std::cerr << "Warning: -retrain is ignored, unsupervised embeddings "
+                      << "are quantized as trained." << std::endl;
+        }
+
+        std::shared_ptr<const DenseMatrix> input = getDenseInput();
+        std::shared_ptr<const DenseMatrix> output = toDense(output_);
+        // words are sorted by decreasing count, so the cutoff keeps a prefix
+        int64_t nwords = dict_->nwords();
+        if (args_->cutoff > 0 && int64_t(args_->cutoff) < nwords) {
+            nwords = args_->cutoff;
+            dict_->truncate(nwords);
+        }
+        // contiguous copies of the kept rows, whatever the source stride
+        auto copyRows = [&](const DenseMatrix& from) {
+            DenseMatrix rows(nwords, args_->dim);
+            for (int64_t i = 0; i < nwords; i++) {
+                std::copy(from.row(i), from.row(i) + args_->dim, rows.row(i));
+            }
+            return rows;
+        };
+        DenseMatrix inputRows = copyRows(*input);
+        DenseMatrix outputRows = copyRows(*output);
+
+        input_ = std::make_shared<QuantMatrix>(
+                std::move(inputRows), args_->dsub, args_->qnorm, args_->thread);
+        if (args_->qout) {
+            output_ = std::make_shared<QuantMatrix>(
+                    std::move(outputRows), args_->dsub, args_->qnorm, args_->thread);
+        } else {
+            output_ = std::make_shared<DenseMatrix>(std::move(outputRows));
+        }
+        quant_ = true;
+        model_ = nullptr;
+        neighbors_ = nullptr;
+        hnsw_ = nullptr;
+    }
+
+    bool FastText::isQuant() const {
+        return quant_;
+    }
+
+    std::shared_ptr<const Args> FastText::getArgs() const {
+        return args_;
+    }
+
+    std::shared_ptr<const Dictionary> FastText::getDictionary() const {
+        return dict_;
+    }
+
+    std::shared_ptr<const Matrix> FastText::getInputMatrix() const {
+        return input_;
+    }
+
+    std::shared_ptr<const Matrix> FastText::getOutputMatrix() const {
+        return output_;
+    }
+
+    void FastText::getWordVector(Vector& vec, const std::string& word) const {
+        const int32_t & dictId = dict_->getId(word);
+        vec.zero();
+        addInputVector(vec, dictId);
+    }
+
+    // Rows are formatted in chunks on args_->thread threads and written in
+    // order; the bytes match streaming each row as
+    // "word " << vec << std::endl. With several shards, shard i holds a
+    // contiguous range of rows (the header goes into the first one), so
+    // concatenating the shards gives the single-file output.
+    void FastText::saveRows(const std::string& filename, const Matrix& matrix) const {
+        const int64_t n = dict_->nwords();
+        const int32_t dim = args_->dim;
+        const int32_t nthreads = std::max(1, args_->thread);
+        const int32_t shards = std::max(1, args_->exportShards);
+        const DenseMatrix* dense = dynamic_cast<const DenseMatrix*>(&matrix);
+
+        auto formatRows = [&](int64_t begin, int64_t end, std::string& out) {
+            out.clear();
+            Vector vec(dim);
+            char buf[32];
+            for (int64_t i = begin; i < end; i++) {
+                out.append(dict_->getWord(i));
+                out.push_back(' ');
+                const real* row;
+                if (dense) {
+                    row = dense->row(i);
+                } else {
+                    vec.zero();
+                    vec.addRow(matrix, i);
+                    row = vec.data();
+                }
+                for (int32_t j = 0; j < dim; j++) {
+                    out.append(buf, utils::formatFloat(buf, row[j], 5));
+                    out.push_back(' ');
+                }
+                out.push_back('\n');
+            }
+        };
+
+        const std::string width = std::to_string(shards - 1);
+        std::vector<std::string> buffers(nthreads);
+        for (int32_t shard = 0; shard < shards; shard++) {
+            std::string name = filename;
+            if (shards > 1) {
+                std::string index = std::to_string(shard);
+                name += "." + std::string(width.size() - index.size(), '0') + index;
+            }
+            std::ofstream ofs(name, std::ofstream::binary);
+            if (!ofs.is_open()) {
+                throw std::invalid_argument(
+                        name + " cannot be opened for saving vectors!");
+            }
+            if (shard == 0) {
+                ofs << n << " " << dim << "\n";
+            }
+            const int64_t shardBegin = shard * n / shards;
+            const int64_t shardEnd = (shard + 1) * n / shards;
+            for (int64_t begin = shardBegin; begin < shardEnd;
+                 begin += nthreads * EXPORT_CHUNK_ROWS) {
+                std::vector<std::thread> threads;
+                for (int32_t t = 0; t < nthreads; t++) {
+                    int64_t b = std::min(shardEnd, begin + t * EXPORT_CHUNK_ROWS);
+                    int64_t e = std::min(shardEnd, b + EXPORT_CHUNK_ROWS);
+                    threads.push_back(std::thread(
+                            [&, t, b, e]() { formatRows(b, e, buffers[t]); }));
+                }
+                for (int32_t t = 0; t < nthreads; t++) {
+                    threads[t].join();
+                    ofs.write(buffers[t].data(), buffers[t].size());
+                }
+            }
+            ofs.close();
+            if (!ofs) {
+                throw std::runtime_error(name + " cannot be written!");
+            }
+        }
+    }
+
+    void FastText::saveVectors(const std::string& filename) {
+        if (!input_ || !output_) {
+            throw std::runtime_error("Model never trained");
+        }
+        saveRows(filename, *input_);
+    }
+
+    void FastText::saveOutput(const std::string& filename) {
+        if (!input_ || !output_) {
+            throw std::runtime_error("Model never trained");
+        }
+        saveRows(filename, *output_);
     }
 
     void FastText::addInputVector(Vector& vec, int32_t ind) const {
@@ -231,9 +1251,12 @@ namespace fasttext {
     std::shared_ptr<Loss> FastText::createLoss(std::shared_ptr<Matrix>& output) {
         loss_name lossName = args_->loss;
         switch (lossName) {
-            case loss_name::ns:
-                return std::make_shared<NegativeSamplingLoss>(
-                        output, args_->neg, getTargetCounts());
+            case loss_name::ns: {
+                auto loss = std::make_shared<NegativeSamplingLoss>(
+                        output, args_->neg, args_->negPower, getTargetCounts());
+                loss->replicateHotRows(args_->hotRows, args_->hotSync);
+                return loss;
+            }
             default:
                 throw std::runtime_error("Unknown loss");
         }
@@ -248,6 +1271,12 @@ namespace fasttext {
     }
 
     FastText::FastText()
-            : wordVectors_(nullptr), trainException_(nullptr) {}
+            : quant_(false),
+              tokenCount_(&ownTokenCount_),
+              wordVectors_(nullptr),
+              trainException_(nullptr),
+              startTokenCount_(0),
+              checkpointPid_(-1),
+              tokenBudget_(0) {}
 
 } // namespace fasttext
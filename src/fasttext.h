@@ -16,14 +16,25 @@
 #include <memory>
 #include <queue>
 #include <set>
+#include <stdexcept>
+#include <string>
 #include <tuple>
 
 #include "args.h"
+#include "averager.h"
+#include "corpuscache.h"
 #include "densematrix.h"
 #include "dictionary.h"
+#include "halfmatrix.h"
 #include "matrix.h"
+#include "hnsw.h"
 #include "model.h"
+#include "neighbors.h"
+#include "quantmatrix.h"
 #include "real.h"
+#include "rng.h"
+#include "sharedmodel.h"
+#include "streamreader.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -36,32 +47,148 @@ namespace fasttext {
         std::shared_ptr<Matrix> input_;
         std::shared_ptr<Matrix> output_;
         std::shared_ptr<Model> model_;
-        std::atomic<int64_t> tokenCount_{};
+        std::shared_ptr<CorpusCache> cache_;
+        std::shared_ptr<NearestNeighbors> neighbors_;
+        std::shared_ptr<Hnsw> hnsw_;
+        bool quant_;
+        std::atomic<int64_t> ownTokenCount_{};
+        // ownTokenCount_, or the count of all the workers with -shm
+        std::atomic<int64_t>* tokenCount_;
         std::atomic<real> lossFirst_{};
         std::atomic<real> lossSecond_{};
         std::chrono::steady_clock::time_point start_;
         std::unique_ptr<DenseMatrix> wordVectors_;
         std::exception_ptr trainException_;
+        // cpu of training thread i is cpus_[i % cpus_.size()] (-pin)
+        std::vector<int32_t> cpus_;
 
+        // What a training thread has consumed so far: its generator and
+        // the input position (file offset or cache line, -1 for its
+        // default start). The thread fills the slot that is not current
+        // and then flips current, so a fork()ed snapshot taken at any
+        // moment sees a complete one.
+        struct ThreadProgress {
+            Rng rng[2];
+            int64_t position[2] = {-1, -1};
+            std::atomic<int32_t> current{0};
+        };
+        std::vector<ThreadProgress> progress_;
+        std::atomic<bool> stop_{};
+        int64_t startTokenCount_;
+        int64_t checkpointPid_;
+        // tokens the learning rate decays over: epoch * ntokens for a
+        // file, -tokenBudget or an estimate for stdin (0 if unknown)
+        int64_t tokenBudget_;
+        std::shared_ptr<StreamReader> stream_;
+        // with -workers > 1, for the duration of train()
+        std::shared_ptr<ModelAverager> averager_;
+        // with -shm, for the duration of train()
+        std::shared_ptr<SharedModel> shared_;
+
+        void loadCache();
+        void openStdin();
+        void warmStart(const std::string& filename);
+        static const int64_t MATRIX_ALIGNMENT = 4096;
+        static const int32_t PRESCORE_FACTOR = 8;
+        static const int64_t EXPORT_CHUNK_ROWS = 2048;
+        static constexpr real MAX_STREAM_PROGRESS = 0.99;
+
+        bool checkModel(std::istream&);
+        void signModel(std::ostream&) const;
+        void saveMatrix(std::ostream&, const Matrix&) const;
+        std::shared_ptr<Matrix> loadMatrix(
+                std::istream&, std::shared_ptr<utils::MappedFile>, bool quant) const;
+        std::shared_ptr<const DenseMatrix> getDenseInput() const;
+        static std::shared_ptr<const DenseMatrix> toDense(
+                std::shared_ptr<const Matrix>);
+        std::shared_ptr<NearestNeighbors> getNeighbors(bool int8);
+        void saveRows(const std::string& filename, const Matrix& matrix) const;
         void startThreads();
+        void publishProgress(int32_t threadId, const Rng& rng, int64_t position);
+        bool saveCheckpoint(const std::string& filename) const;
+        void loadCheckpoint(const std::string& filename);
+        std::shared_ptr<Matrix> loadTrainMatrix(std::istream&) const;
         void addInputVector(Vector&, int32_t) const;
         void trainThread(int32_t);
         void printInfo(real, real, real, std::ostream&);
+        void createTrainMatrices();
         std::shared_ptr<Matrix> createRandomMatrix() const;
         std::shared_ptr<Matrix> createTrainOutputMatrix() const;
         std::vector<int64_t> getTargetCounts() const;
         std::shared_ptr<Loss> createLoss(std::shared_ptr<Matrix>& output);
         void skipgram(Model::State& state, real lr, const std::vector<int32_t>& line);
-        bool keepTraining(const int64_t ntokens) const;
+        bool keepTraining() const;
+        real trainingProgress() const;
     public:
+        // Thrown by train when SIGTERM stopped it after a final checkpoint.
+        class TrainingInterrupted : public std::runtime_error {
+        public:
+            explicit TrainingInterrupted(const std::string& checkpoint)
+                    : std::runtime_error(
+                              "Training interrupted, checkpoint saved to " +
+                              checkpoint) {}
+        };
+
         FastText();
 
+        std::shared_ptr<const Args> getArgs() const;
+
+        std::shared_ptr<const Dictionary> getDictionary() const;
+
+        std::shared_ptr<const Matrix> getInputMatrix() const;
+
+        std::shared_ptr<const Matrix> getOutputMatrix() const;
+
         void getWordVector(Vector& vec, const std::string& word) const;
 
+        std::vector<std::pair<real, std::string>> getNN(
+                const std::string& word, int32_t k);
+
+        // Nearest neighbours of many words at once, each query word
+        // excluded from its own list. With int8 the rows are prescored
+        // with int8 codes and the best PRESCORE_FACTOR * k are reranked.
+        std::vector<std::vector<std::pair<real, std::string>>> getNN(
+                const std::vector<std::string>& words, int32_t k, bool int8 = false);
+
+        // Answers to analogy questions (a, b, c), i.e. the k nearest
+        // neighbours of b - a + c with a, b and c themselves excluded.
+        // Questions with an unknown word get no answers.
+        std::vector<std::vector<std::pair<real, std::string>>> getAnalogies(
+                const std::vector<std::vector<std::string>>& questions,
+                int32_t k,
+                bool int8 = false);
+
+        // Approximate neighbours from the HNSW index; ef trades recall for
+        // latency.
+        std::vector<std::vector<std::pair<real, std::string>>> getApproxNN(
+                const std::vector<std::string>& words, int32_t k, int32_t ef) const;
+
+        void buildIndex(int32_t M, int32_t efConstruction);
+
+        void saveIndex(const std::string& filename) const;
+
+        void loadIndex(const std::string& filename);
+
+        // Product-quantizes the input matrix (and the output one with
+        // -qout), keeping only the -cutoff most frequent words if set.
+        void quantize(const Args& qargs);
+
+        bool isQuant() const;
+
+        void saveModel(const std::string& filename);
+
+        void loadModel(const std::string& filename, bool mmap = true);
+
         void saveVectors(const std::string& filename);
 
         void saveOutput(const std::string& filename);
 
+        // With -checkpoint N, a snapshot is written to <output>.ckpt every N
+        // seconds by a forked child while the threads keep training, and
+        // SIGTERM stops training after a final one. -resume continues
+        // from the checkpoint, mid-epoch; the fasttext command removes it
+        // once the model is saved. With -pretrainedVectors, training
+        // starts from the rows of that .bin or .vec file (see warmStart).
         void train(const Args& args);
     };
 } // namespace fasttext
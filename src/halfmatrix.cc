@@ -0,0 +1,252 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "halfmatrix.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "densematrix.h"
+#include "kernels.h"
+#include "rng.h"
+
+namespace fasttext {
+
+namespace {
+
+// One row of fp32 scratch per thread for the widened half rows.
+real* scratch(int64_t n) {
+  thread_local std::vector<real> buffer;
+  if (int64_t(buffer.size()) < n) {
+    buffer.resize(n);
+  }
+  return buffer.data();
+}
+
+// bf16 keeps 8 mantissa bits, so most SGD steps are below half an ulp of
+// the weight and round-to-nearest would drop them; rounding up with
+// probability proportional to the remainder keeps them in expectation.
+// One draw per row is spread over the columns with a Weyl sequence: each
+// element still gets uniform noise across updates, and the loop vectorizes.
+void floatToBf16Stochastic(const real* x, uint16_t* y, int64_t n) {
+  static std::atomic<uint64_t> streams(0);
+  thread_local Rng rng(0x6266313672ull, streams++);
+  const uint32_t base = rng.next32();
+  for (int64_t i = 0; i < n; i++) {
+    uint32_t bits;
+    std::memcpy(&bits, &x[i], sizeof(bits));
+    const uint32_t noise = (base + uint32_t(i) * 0x9e3779b9u) >> 16;
+    const uint16_t rounded = uint16_t((bits + noise) >> 16);
+    const uint16_t nan = uint16_t((bits >> 16) | 0x40);
+    y[i] = (bits & 0x7fffffff) > 0x7f800000 ? nan : rounded;
+  }
+}
+
+} // namespace
+
+HalfMatrix::HalfMatrix()
+    : Matrix(), precision_(precision_name::bf16), fullRows_(0) {}
+
+HalfMatrix::HalfMatrix(
+    int64_t m,
+    int64_t n,
+    precision_name precision,
+    int64_t fullRows)
+    : Matrix(m, n),
+      precision_(precision),
+      fullRows_(std::max(int64_t(0), std::min(m, fullRows))),
+      full_(fullRows_ * n),
+      half_((m - fullRows_) * n) {
+  if (precision_ == precision_name::fp32) {
+    throw std::invalid_argument("HalfMatrix needs bf16 or fp16 precision!");
+  }
+}
+
+const real* HalfMatrix::widen(int64_t i, real* scratch) const {
+  if (i < fullRows_) {
+    return full_.data() + i * n_;
+  }
+  const kernels::KernelTable& kt = kernels::get();
+  if (precision_ == precision_name::bf16) {
+    kt.bf16ToFloat(halfRow(i), scratch, n_);
+  } else {
+    kt.fp16ToFloat(halfRow(i), scratch, n_);
+  }
+  return scratch;
+}
+
+void HalfMatrix::narrow(const real* x, int64_t i) {
+  if (precision_ == precision_name::bf16) {
+    floatToBf16Stochastic(x, halfRow(i), n_);
+  } else {
+    kernels::get().floatToFp16(x, halfRow(i), n_);
+  }
+}
+
+void HalfMatrix::uniformThread(
+    real a,
+    int64_t chunkBegin,
+    int64_t chunkEnd,
+    int32_t seed) {
+  const int64_t end = std::min(m_ * n_, chunkEnd * INIT_CHUNK);
+  const double scale = 2.0 * a / double(uint64_t(1) << 53);
+  std::vector<real> values(INIT_CHUNK);
+  for (int64_t chunk = chunkBegin; chunk < chunkEnd; chunk++) {
+    Rng rng((uint64_t(uint32_t(seed)) << 32) | uint64_t(chunk));
+    const int64_t first = chunk * INIT_CHUNK;
+    const int64_t count = std::min(end, first + INIT_CHUNK) - first;
+    for (int64_t j = 0; j < count; j++) {
+      values[j] = real(double(rng() >> 11) * scale - a);
+    }
+    // the chunk is flat, so it may start or end in the middle of a row
+    for (int64_t j = 0; j < count;) {
+      const int64_t i = (first + j) / n_, c = (first + j) % n_;
+      const int64_t len = std::min(count - j, n_ - c);
+      if (i < fullRows_) {
+        std::copy(
+            values.data() + j, values.data() + j + len, &full_[i * n_ + c]);
+      } else if (precision_ == precision_name::bf16) {
+        kernels::get().floatToBf16(values.data() + j, halfRow(i) + c, len);
+      } else {
+        kernels::get().floatToFp16(values.data() + j, halfRow(i) + c, len);
+      }
+      j += len;
+    }
+  }
+}
+
+void HalfMatrix::uniform(real a, unsigned int thread, int32_t seed) {
+  const int64_t nchunks = (m_ * n_ + INIT_CHUNK - 1) / INIT_CHUNK;
+  const int64_t nthreads =
+      std::max(int64_t(1), std::min(int64_t(thread), nchunks));
+  std::vector<std::thread> threads;
+  for (int64_t i = 0; i < nthreads; i++) {
+    threads.push_back(std::thread([=]() {
+      uniformThread(a, i * nchunks / nthreads, (i + 1) * nchunks / nthreads, seed);
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+precision_name HalfMatrix::precision() const {
+  return precision_;
+}
+
+int64_t HalfMatrix::fullRows() const {
+  return fullRows_;
+}
+
+int64_t HalfMatrix::memoryBytes() const {
+  return full_.size() * sizeof(real) + half_.size() * sizeof(uint16_t);
+}
+
+void HalfMatrix::scalerMulRow(real a, int64_t id) {
+  assert(id >= 0 && id < m_);
+  if (id < fullRows_) {
+    kernels::get().scale(a, full_.data() + id * n_, n_);
+    return;
+  }
+  real* x = scratch(n_);
+  widen(id, x);
+  kernels::get().scale(a, x, n_);
+  narrow(x, id);
+}
+
+real HalfMatrix::l2NormRow(int64_t i) const {
+  auto norm = kernels::get().sqnorm(widen(i, scratch(n_)), n_);
+  if (std::isnan(norm)) {
+    throw DenseMatrix::EncounteredNaNError();
+  }
+  return std::sqrt(norm);
+}
+
+real HalfMatrix::dotRow(const Vector& vec, int64_t i) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(vec.size() == n_);
+  real d = kernels::get().dot(widen(i, scratch(n_)), vec.data(), n_);
+  if (std::isnan(d)) {
+    throw DenseMatrix::EncounteredNaNError();
+  }
+  return d;
+}
+
+void HalfMatrix::addVectorToRow(const Vector& vec, int64_t i, real a) {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(vec.size() == n_);
+  if (i < fullRows_) {
+    kernels::get().axpy(a, vec.data(), full_.data() + i * n_, n_);
+    return;
+  }
+  real* x = scratch(n_);
+  widen(i, x);
+  kernels::get().axpy(a, vec.data(), x, n_);
+  narrow(x, i);
+}
+
+void HalfMatrix::addRowToVector(Vector& x, int32_t i) const {
+  addRowToVector(x, i, 1.0);
+}
+
+void HalfMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(x.size() == n_);
+  kernels::get().axpy(a, widen(i, scratch(n_)), x.data(), n_);
+}
+
+void HalfMatrix::save(std::ostream& out) const {
+  out.write((char*)&precision_, sizeof(precision_));
+  out.write((char*)&m_, sizeof(m_));
+  out.write((char*)&n_, sizeof(n_));
+  out.write((char*)&fullRows_, sizeof(fullRows_));
+  out.write((char*)full_.data(), full_.size() * sizeof(real));
+  out.write((char*)half_.data(), half_.size() * sizeof(uint16_t));
+}
+
+void HalfMatrix::load(std::istream& in) {
+  in.read((char*)&precision_, sizeof(precision_));
+  in.read((char*)&m_, sizeof(m_));
+  in.read((char*)&n_, sizeof(n_));
+  in.read((char*)&fullRows_, sizeof(fullRows_));
+  if (!in || m_ < 0 || n_ < 0 || fullRows_ < 0 || fullRows_ > m_ ||
+      precision_ == precision_name::fp32) {
+    throw std::invalid_argument("Invalid half precision matrix!");
+  }
+  full_ = std::vector<real>(fullRows_ * n_);
+  half_ = std::vector<uint16_t>((m_ - fullRows_) * n_);
+  in.read((char*)full_.data(), full_.size() * sizeof(real));
+  in.read((char*)half_.data(), half_.size() * sizeof(uint16_t));
+  if (!in) {
+    throw std::invalid_argument("Invalid half precision matrix!");
+  }
+}
+
+void HalfMatrix::dump(std::ostream& out) const {
+  out << m_ << " " << n_ << std::endl;
+  std::vector<real> row(n_);
+  for (int64_t i = 0; i < m_; i++) {
+    const real* x = widen(i, row.data());
+    for (int64_t j = 0; j < n_; j++) {
+      if (j > 0) {
+        out << " ";
+      }
+      out << x[j];
+    }
+    out << std::endl;
+  }
+}
+
+} // namespace fasttext
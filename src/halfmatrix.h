@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "args.h"
+#include "matrix.h"
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Matrix stored in 16-bit floats (bf16 or fp16), except for the first
+// fullRows rows which stay fp32: rows are sorted by decreasing frequency,
+// so those are the ones updated most often. Operations widen a row to
+// fp32, run the regular kernels on it and round an updated row back once,
+// so all arithmetic is done in fp32. bf16 rows are rounded stochastically
+// after an update, fp16 ones (which have 3 more mantissa bits) to nearest.
+class HalfMatrix : public Matrix {
+ protected:
+  static const int64_t INIT_CHUNK = 1024;
+
+  precision_name precision_;
+  int64_t fullRows_;
+  std::vector<real> full_;
+  std::vector<uint16_t> half_;
+
+  inline const uint16_t* halfRow(int64_t i) const {
+    return half_.data() + (i - fullRows_) * n_;
+  }
+  inline uint16_t* halfRow(int64_t i) {
+    return half_.data() + (i - fullRows_) * n_;
+  }
+  // row i in fp32: a pointer into full_, or `scratch` filled from half_
+  const real* widen(int64_t i, real* scratch) const;
+  void narrow(const real* x, int64_t i);
+  void uniformThread(real, int64_t, int64_t, int32_t);
+
+ public:
+  HalfMatrix();
+  HalfMatrix(int64_t m, int64_t n, precision_name precision, int64_t fullRows);
+  HalfMatrix(const HalfMatrix&) = delete;
+  HalfMatrix& operator=(const HalfMatrix&) = delete;
+  virtual ~HalfMatrix() noexcept override = default;
+
+  // Same values as DenseMatrix::uniform with the same seed, rounded.
+  void uniform(real a, unsigned int thread, int32_t seed);
+
+  precision_name precision() const;
+  int64_t fullRows() const;
+  int64_t memoryBytes() const;
+
+  void scalerMulRow(real a, int64_t id) override;
+  real l2NormRow(int64_t i) const override;
+  real dotRow(const Vector&, int64_t) const override;
+  void addVectorToRow(const Vector&, int64_t, real) override;
+  void addRowToVector(Vector& x, int32_t i) const override;
+  void addRowToVector(Vector& x, int32_t i, real a) const override;
+  void save(std::ostream&) const override;
+  void load(std::istream&) override;
+  void dump(std::ostream&) const override;
+};
+
+} // namespace fasttext
@@ -0,0 +1,364 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "hnsw.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "kernels.h"
+
+namespace fasttext {
+
+Hnsw::Hnsw(
+    std::shared_ptr<const DenseMatrix> matrix,
+    int32_t M,
+    int32_t efConstruction)
+    : matrix_(matrix),
+      M_(std::max(M, 2)),
+      maxM0_(2 * std::max(M, 2)),
+      efConstruction_(std::max(efConstruction, 1)),
+      entry_(-1),
+      maxLevel_(-1) {}
+
+int32_t Hnsw::M() const {
+  return M_;
+}
+
+int32_t Hnsw::efConstruction() const {
+  return efConstruction_;
+}
+
+int32_t* Hnsw::links(int32_t id, int32_t level) {
+  if (level == 0) {
+    return links0_.data() + int64_t(id) * (maxM0_ + 1);
+  }
+  return upper_[id].data() + (level - 1) * (M_ + 1);
+}
+
+const int32_t* Hnsw::links(int32_t id, int32_t level) const {
+  if (level == 0) {
+    return links0_.data() + int64_t(id) * (maxM0_ + 1);
+  }
+  return upper_[id].data() + (level - 1) * (M_ + 1);
+}
+
+int32_t Hnsw::maxLinks(int32_t level) const {
+  return level == 0 ? maxM0_ : M_;
+}
+
+real Hnsw::score(const real* query, int32_t id) const {
+  return kernels::get().dot(query, matrix_->row(id), matrix_->cols());
+}
+
+// While building, adjacency lists are copied out under the node's lock.
+int32_t Hnsw::greedy(const real* query, int32_t cur, int32_t level, bool locked)
+    const {
+  std::vector<int32_t> neighbors;
+  real best = score(query, cur);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    {
+      std::unique_lock<std::mutex> lock;
+      if (locked) {
+        lock = std::unique_lock<std::mutex>(nodeLocks_[cur]);
+      }
+      const int32_t* l = links(cur, level);
+      neighbors.assign(l + 1, l + 1 + l[0]);
+    }
+    for (int32_t n : neighbors) {
+      real s = score(query, n);
+      if (s > best) {
+        best = s;
+        cur = n;
+        changed = true;
+      }
+    }
+  }
+  return cur;
+}
+
+std::vector<Hnsw::Neighbor> Hnsw::searchLayer(
+    const real* query,
+    int32_t enter,
+    int32_t ef,
+    int32_t level,
+    Scratch& scratch,
+    bool locked) const {
+  if (int64_t(scratch.visited.size()) < matrix_->rows()) {
+    scratch.visited.assign(matrix_->rows(), 0);
+    scratch.epoch = 0;
+  }
+  if (++scratch.epoch == 0) {
+    std::fill(scratch.visited.begin(), scratch.visited.end(), 0);
+    scratch.epoch = 1;
+  }
+  std::priority_queue<Neighbor> candidates;
+  std::priority_queue<Neighbor, std::vector<Neighbor>, std::greater<Neighbor>>
+      results;
+  real s = score(query, enter);
+  candidates.push(Neighbor(s, enter));
+  results.push(Neighbor(s, enter));
+  scratch.visited[enter] = scratch.epoch;
+
+  std::vector<int32_t> neighbors;
+  while (!candidates.empty()) {
+    Neighbor c = candidates.top();
+    if (int32_t(results.size()) >= ef && c.first < results.top().first) {
+      break;
+    }
+    candidates.pop();
+    {
+      std::unique_lock<std::mutex> lock;
+      if (locked) {
+        lock = std::unique_lock<std::mutex>(nodeLocks_[c.second]);
+      }
+      const int32_t* l = links(c.second, level);
+      neighbors.assign(l + 1, l + 1 + l[0]);
+    }
+    for (int32_t n : neighbors) {
+      if (scratch.visited[n] == scratch.epoch) {
+        continue;
+      }
+      scratch.visited[n] = scratch.epoch;
+      s = score(query, n);
+      if (int32_t(results.size()) < ef || s > results.top().first) {
+        candidates.push(Neighbor(s, n));
+        results.push(Neighbor(s, n));
+        if (int32_t(results.size()) > ef) {
+          results.pop();
+        }
+      }
+    }
+  }
+  std::vector<Neighbor> found(results.size());
+  for (int32_t i = found.size() - 1; i >= 0; i--) {
+    found[i] = results.top();
+    results.pop();
+  }
+  return found;
+}
+
+// Keeps a candidate only if it is closer to the query than to every
+// neighbour already kept, which spreads links across directions.
+std::vector<int32_t> Hnsw::selectNeighbors(
+    std::vector<Neighbor> candidates,
+    int32_t m) const {
+  std::sort(candidates.begin(), candidates.end(), std::greater<Neighbor>());
+  std::vector<int32_t> selected;
+  for (const Neighbor& c : candidates) {
+    if (int32_t(selected.size()) >= m) {
+      break;
+    }
+    bool keep = true;
+    for (int32_t s : selected) {
+      if (score(matrix_->row(c.second), s) > c.first) {
+        keep = false;
+        break;
+      }
+    }
+    if (keep) {
+      selected.push_back(c.second);
+    }
+  }
+  return selected;
+}
+
+void Hnsw::connect(int32_t id, int32_t neighbor, int32_t level) {
+  std::lock_guard<std::mutex> lock(nodeLocks_[neighbor]);
+  int32_t* l = links(neighbor, level);
+  if (std::find(l + 1, l + 1 + l[0], id) != l + 1 + l[0]) {
+    return;
+  }
+  if (l[0] < maxLinks(level)) {
+    l[1 + l[0]++] = id;
+    return;
+  }
+  const real* row = matrix_->row(neighbor);
+  std::vector<Neighbor> candidates;
+  candidates.push_back(Neighbor(score(row, id), id));
+  for (int32_t i = 0; i < l[0]; i++) {
+    candidates.push_back(Neighbor(score(row, l[1 + i]), l[1 + i]));
+  }
+  std::vector<int32_t> selected = selectNeighbors(candidates, maxLinks(level));
+  l[0] = selected.size();
+  std::copy(selected.begin(), selected.end(), l + 1);
+}
+
+void Hnsw::insert(int32_t id, Scratch& scratch) {
+  const int32_t level = levels_[id];
+  std::unique_lock<std::mutex> entryLock(entryLock_);
+  const int32_t enter = entry_;
+  const int32_t maxLevel = maxLevel_;
+  if (level <= maxLevel) {
+    entryLock.unlock();
+  }
+  const real* query = matrix_->row(id);
+  int32_t cur = enter;
+  for (int32_t l = maxLevel; l > level; l--) {
+    cur = greedy(query, cur, l, true);
+  }
+  for (int32_t l = std::min(level, maxLevel); l >= 0; l--) {
+    std::vector<Neighbor> candidates =
+        searchLayer(query, cur, efConstruction_, l, scratch, true);
+    candidates.erase(
+        std::remove_if(
+            candidates.begin(),
+            candidates.end(),
+            [id](const Neighbor& c) { return c.second == id; }),
+        candidates.end());
+    if (candidates.empty()) {
+      continue;
+    }
+    std::vector<int32_t> selected = selectNeighbors(candidates, M_);
+    {
+      std::lock_guard<std::mutex> lock(nodeLocks_[id]);
+      int32_t* own = links(id, l);
+      own[0] = selected.size();
+      std::copy(selected.begin(), selected.end(), own + 1);
+    }
+    for (int32_t n : selected) {
+      connect(id, n, l);
+    }
+    cur = candidates[0].second;
+  }
+  if (level > maxLevel) {
+    entry_ = id;
+    maxLevel_ = level;
+  }
+}
+
+void Hnsw::build(int32_t nthreads, int32_t seed) {
+  const int64_t m = matrix_->rows();
+  std::minstd_rand rng(seed);
+  std::uniform_real_distribution<> uniform(0, 1);
+  const double mult = 1.0 / std::log(double(M_));
+  levels_.resize(m);
+  upper_.assign(m, std::vector<int32_t>());
+  for (int64_t i = 0; i < m; i++) {
+    levels_[i] = int32_t(-std::log(1.0 - uniform(rng)) * mult);
+    upper_[i].assign(levels_[i] * (M_ + 1), 0);
+  }
+  links0_.assign(m * (maxM0_ + 1), 0);
+  nodeLocks_.reset(new std::mutex[m]);
+  entry_ = -1;
+  maxLevel_ = -1;
+  if (m == 0) {
+    return;
+  }
+  entry_ = 0;
+  maxLevel_ = levels_[0];
+
+  std::atomic<int64_t> next(1);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < std::max(nthreads, 1); t++) {
+    threads.push_back(std::thread([&]() {
+      Scratch scratch;
+      for (int64_t i = next++; i < m; i = next++) {
+        insert(i, scratch);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+std::vector<Hnsw::Neighbor> Hnsw::search(
+    const real* query,
+    int32_t k,
+    int32_t ef,
+    Scratch& scratch,
+    int32_t exclude) const {
+  if (entry_ < 0 || k <= 0) {
+    return std::vector<Neighbor>();
+  }
+  int32_t cur = entry_;
+  for (int32_t l = maxLevel_; l > 0; l--) {
+    cur = greedy(query, cur, l, false);
+  }
+  std::vector<Neighbor> found =
+      searchLayer(query, cur, std::max(ef, k + 1), 0, scratch, false);
+  found.erase(
+      std::remove_if(
+          found.begin(),
+          found.end(),
+          [exclude](const Neighbor& c) { return c.second == exclude; }),
+      found.end());
+  if (int32_t(found.size()) > k) {
+    found.resize(k);
+  }
+  return found;
+}
+
+std::vector<Hnsw::Neighbor>
+Hnsw::search(const real* query, int32_t k, int32_t ef, int32_t exclude) const {
+  Scratch scratch;
+  return search(query, k, ef, scratch, exclude);
+}
+
+void Hnsw::save(std::ostream& out) const {
+  const int32_t magic = HNSW_MAGIC_INT32;
+  const int32_t version = HNSW_VERSION;
+  const int64_t m = matrix_->rows(), n = matrix_->cols();
+  out.write((char*)&magic, sizeof(int32_t));
+  out.write((char*)&version, sizeof(int32_t));
+  out.write((char*)&m, sizeof(int64_t));
+  out.write((char*)&n, sizeof(int64_t));
+  out.write((char*)&M_, sizeof(int32_t));
+  out.write((char*)&efConstruction_, sizeof(int32_t));
+  out.write((char*)&entry_, sizeof(int32_t));
+  out.write((char*)&maxLevel_, sizeof(int32_t));
+  out.write((char*)levels_.data(), m * sizeof(int32_t));
+  out.write((char*)links0_.data(), links0_.size() * sizeof(int32_t));
+  for (int64_t i = 0; i < m; i++) {
+    out.write((char*)upper_[i].data(), upper_[i].size() * sizeof(int32_t));
+  }
+}
+
+void Hnsw::load(std::istream& in) {
+  int32_t magic, version;
+  int64_t m, n;
+  in.read((char*)&magic, sizeof(int32_t));
+  in.read((char*)&version, sizeof(int32_t));
+  in.read((char*)&m, sizeof(int64_t));
+  in.read((char*)&n, sizeof(int64_t));
+  if (!in || magic != HNSW_MAGIC_INT32 || version != HNSW_VERSION) {
+    throw std::invalid_argument("Not an HNSW index!");
+  }
+  if (m != matrix_->rows() || n != matrix_->cols()) {
+    throw std::invalid_argument("HNSW index does not match the model!");
+  }
+  in.read((char*)&M_, sizeof(int32_t));
+  in.read((char*)&efConstruction_, sizeof(int32_t));
+  in.read((char*)&entry_, sizeof(int32_t));
+  in.read((char*)&maxLevel_, sizeof(int32_t));
+  maxM0_ = 2 * M_;
+  levels_.resize(m);
+  in.read((char*)levels_.data(), m * sizeof(int32_t));
+  links0_.resize(m * (maxM0_ + 1));
+  in.read((char*)links0_.data(), links0_.size() * sizeof(int32_t));
+  upper_.assign(m, std::vector<int32_t>());
+  for (int64_t i = 0; i < m; i++) {
+    upper_[i].resize(levels_[i] * (M_ + 1));
+    in.read((char*)upper_[i].data(), upper_[i].size() * sizeof(int32_t));
+  }
+  if (!in) {
+    throw std::invalid_argument("Truncated HNSW index!");
+  }
+  nodeLocks_.reset();
+}
+
+} // namespace fasttext
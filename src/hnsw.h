@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "densematrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+// Hierarchical navigable small world graph (Malkov & Yashunin) over the
+// rows of a matrix, searched by inner product. The rows must be
+// unit-norm for the neighbour-selection heuristic to make sense, which
+// is the case for trained input vectors.
+//
+// Nodes are inserted by several threads at once; each node's adjacency
+// lists are guarded by their own mutex while the graph is built. Once
+// built, the graph is read-only and search() is thread-safe.
+class Hnsw {
+ public:
+  typedef std::pair<real, int32_t> Neighbor;
+
+  // Per-thread search state, reusable across queries.
+  struct Scratch {
+    std::vector<uint32_t> visited;
+    uint32_t epoch = 0;
+  };
+
+  Hnsw(std::shared_ptr<const DenseMatrix> matrix, int32_t M, int32_t efConstruction);
+
+  void build(int32_t nthreads, int32_t seed);
+
+  // The k best rows for the query, best first; ef >= k is the size of
+  // the candidate list on the bottom layer.
+  std::vector<Neighbor> search(
+      const real* query,
+      int32_t k,
+      int32_t ef,
+      Scratch& scratch,
+      int32_t exclude = -1) const;
+  std::vector<Neighbor>
+  search(const real* query, int32_t k, int32_t ef, int32_t exclude = -1) const;
+
+  void save(std::ostream&) const;
+  // Replaces the graph; throws if the file does not match the matrix.
+  void load(std::istream&);
+
+  int32_t M() const;
+  int32_t efConstruction() const;
+
+ private:
+  static const int32_t HNSW_MAGIC_INT32 = 0x57534e48; // "HNSW"
+  static const int32_t HNSW_VERSION = 1;
+
+  std::shared_ptr<const DenseMatrix> matrix_;
+  int32_t M_;
+  int32_t maxM0_;
+  int32_t efConstruction_;
+  int32_t entry_;
+  int32_t maxLevel_;
+  std::vector<int32_t> levels_;
+  // layer 0: (maxM0_ + 1) ints per node, the count first
+  std::vector<int32_t> links0_;
+  // layers 1..level: (M_ + 1) ints per layer, the count first
+  std::vector<std::vector<int32_t>> upper_;
+  std::unique_ptr<std::mutex[]> nodeLocks_;
+  std::mutex entryLock_;
+
+  int32_t* links(int32_t id, int32_t level);
+  const int32_t* links(int32_t id, int32_t level) const;
+  int32_t maxLinks(int32_t level) const;
+  real score(const real* query, int32_t id) const;
+
+  int32_t greedy(const real* query, int32_t cur, int32_t level, bool locked) const;
+  std::vector<Neighbor> searchLayer(
+      const real* query,
+      int32_t enter,
+      int32_t ef,
+      int32_t level,
+      Scratch& scratch,
+      bool locked) const;
+  std::vector<int32_t> selectNeighbors(std::vector<Neighbor> candidates, int32_t m) const;
+  void connect(int32_t id, int32_t neighbor, int32_t level);
+  void insert(int32_t id, Scratch& scratch);
+};
+
+} // namespace fasttext
@@ -0,0 +1,975 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "kernels.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FASTTEXT_X86 1
+#include <immintrin.h>
+#endif
+
+namespace fasttext {
+
+namespace kernels {
+
+namespace {
+
+real dotScalar(const real* x, const real* y, int64_t n) {
+  real d = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+void axpyScalar(real a, const real* x, real* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+void scaleScalar(real a, real* x, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+real sqnormScalar(const real* x, int64_t n) {
+  return dotScalar(x, x, n);
+}
+
+int32_t dotInt8Scalar(const int8_t* x, const int8_t* y, int64_t n) {
+  int32_t d = 0;
+  for (int64_t i = 0; i < n; i++) {
+    d += int32_t(x[i]) * int32_t(y[i]);
+  }
+  return d;
+}
+
+inline real bf16ToFloat1(uint16_t h) {
+  uint32_t bits = uint32_t(h) << 16;
+  real f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint16_t floatToBf16_1(real f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return uint16_t((bits >> 16) | 0x40); // quiet NaN
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return uint16_t(bits >> 16);
+}
+
+inline real fp16ToFloat1(uint16_t h) {
+  const uint32_t sign = uint32_t(h & 0x8000) << 16;
+  const uint32_t exp = (h >> 10) & 0x1f;
+  const uint32_t mant = h & 0x3ff;
+  uint32_t bits;
+  if (exp == 0) {
+    real f = real(mant) * (1.0f / 16777216.0f); // subnormal: mant * 2^-24
+    return sign ? -f : f;
+  } else if (exp == 31) {
+    bits = sign | 0x7f800000 | (mant << 13) | (mant ? 0x400000 : 0);
+  } else {
+    bits = sign | ((exp + 112) << 23) | (mant << 13);
+  }
+  real f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint16_t floatToFp16_1(real f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  const uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+  uint32_t abs = bits & 0x7fffffff;
+  if (abs >= 0x7f800000) {
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+  }
+  if (abs >= 0x477ff000) { // rounds past 65504
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) { // below 2^-14: subnormal or zero
+    real a;
+    std::memcpy(&a, &abs, sizeof(a));
+    return sign | uint16_t(std::nearbyint(a * 16777216.0f));
+  }
+  // rebias the exponent by 15 - 127 and round the 13 dropped bits
+  abs += 0xc8000fff + ((abs >> 13) & 1);
+  return sign | uint16_t(abs >> 13);
+}
+
+void bf16ToFloatScalar(const uint16_t* x, real* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] = bf16ToFloat1(x[i]);
+  }
+}
+
+void floatToBf16Scalar(const real* x, uint16_t* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] = floatToBf16_1(x[i]);
+  }
+}
+
+void fp16ToFloatScalar(const uint16_t* x, real* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] = fp16ToFloat1(x[i]);
+  }
+}
+
+void floatToFp16Scalar(const real* x, uint16_t* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] = floatToFp16_1(x[i]);
+  }
+}
+
+void dotBlockScalar(
+    const real* const* x,
+    int64_t m,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  for (int64_t i = 0; i < m; i++) {
+    for (int64_t j = 0; j < p; j++) {
+      c[i * p + j] = dotScalar(x[i], y[j], n);
+    }
+  }
+}
+
+void axpyBlockScalar(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t m,
+    int64_t n) {
+  for (int64_t i = 0; i < m; i++) {
+    for (int64_t j = 0; j < p; j++) {
+      axpyScalar(a[i * p + j], x[j], y[i], n);
+    }
+  }
+}
+
+const KernelTable kScalar = {"scalar",
+                             dotScalar,
+                             axpyScalar,
+                             scaleScalar,
+                             sqnormScalar,
+                             dotInt8Scalar,
+                             bf16ToFloatScalar,
+                             floatToBf16Scalar,
+                             fp16ToFloatScalar,
+                             floatToFp16Scalar,
+                             dotBlockScalar,
+                             axpyBlockScalar};
+
+#ifdef FASTTEXT_X86
+
+__attribute__((target("sse4.2"))) inline real hsum128(__m128 v) {
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse4.2"))) real
+dotSse42(const real* x, const real* y, int64_t n) {
+  __m128 s0 = _mm_setzero_ps();
+  __m128 s1 = _mm_setzero_ps();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    s1 = _mm_add_ps(
+        s1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+  }
+  for (; i + 4 <= n; i += 4) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+  }
+  real d = hsum128(_mm_add_ps(s0, s1));
+  for (; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+__attribute__((target("sse4.2"))) void
+axpySse42(real a, const real* x, real* y, int64_t n) {
+  __m128 va = _mm_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(
+        y + i,
+        _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  }
+  for (; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+__attribute__((target("sse4.2"))) void scaleSse42(real a, real* x, int64_t n) {
+  __m128 va = _mm_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(x + i, _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+__attribute__((target("sse4.2"))) real sqnormSse42(const real* x, int64_t n) {
+  return dotSse42(x, x, n);
+}
+
+// Sign-extends to int16 and multiply-adds pairs into int32 lanes.
+__attribute__((target("sse4.2"))) int32_t
+dotInt8Sse42(const int8_t* x, const int8_t* y, int64_t n) {
+  __m128i s = _mm_setzero_si128();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(x + i)));
+    __m128i b = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(y + i)));
+    s = _mm_add_epi32(s, _mm_madd_epi16(a, b));
+  }
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  int32_t d = _mm_cvtsi128_si32(s);
+  for (; i < n; i++) {
+    d += int32_t(x[i]) * int32_t(y[i]);
+  }
+  return d;
+}
+
+// Four 128-bit lanes are too few to gain from blocking: one level-1 call
+// per pair of rows.
+__attribute__((target("sse4.2"))) void dotBlockSse42(
+    const real* const* x,
+    int64_t m,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  for (int64_t i = 0; i < m; i++) {
+    for (int64_t j = 0; j < p; j++) {
+      c[i * p + j] = dotSse42(x[i], y[j], n);
+    }
+  }
+}
+
+__attribute__((target("sse4.2"))) void axpyBlockSse42(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t m,
+    int64_t n) {
+  for (int64_t i = 0; i < m; i++) {
+    for (int64_t j = 0; j < p; j++) {
+      axpySse42(a[i * p + j], x[j], y[i], n);
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) inline real hsum256(__m256 v) {
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+  lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+  return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma"))) real
+dotAvx2(const real* x, const real* y, int64_t n) {
+  __m256 s0 = _mm256_setzero_ps();
+  __m256 s1 = _mm256_setzero_ps();
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+    s1 = _mm256_fmadd_ps(
+        _mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), s1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    s0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), s0);
+  }
+  real d = hsum256(_mm256_add_ps(s0, s1));
+  for (; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+__attribute__((target("avx2,fma"))) void
+axpyAvx2(real a, const real* x, real* y, int64_t n) {
+  __m256 va = _mm256_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        y + i,
+        _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  }
+  for (; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+__attribute__((target("avx2,fma"))) void scaleAvx2(real a, real* x, int64_t n) {
+  __m256 va = _mm256_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(va, _mm256_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+__attribute__((target("avx2,fma"))) real sqnormAvx2(const real* x, int64_t n) {
+  return dotAvx2(x, x, n);
+}
+
+__attribute__((target("avx2,fma"))) int32_t
+dotInt8Avx2(const int8_t* x, const int8_t* y, int64_t n) {
+  __m256i s = _mm256_setzero_si256();
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(x + i)));
+    __m256i b = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(y + i)));
+    s = _mm256_add_epi32(s, _mm256_madd_epi16(a, b));
+  }
+  __m128i h = _mm_add_epi32(
+      _mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0x4e));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, 0xb1));
+  int32_t d = _mm_cvtsi128_si32(h);
+  for (; i < n; i++) {
+    d += int32_t(x[i]) * int32_t(y[i]);
+  }
+  return d;
+}
+
+// R rows of x against Q rows of y in one pass over n, with R * Q
+// accumulators: each load of a row feeds Q or R products.
+template <int R, int Q>
+__attribute__((target("avx2,fma"))) void dotTileAvx2(
+    const real* const* x,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  __m256 s[R][Q];
+  for (int r = 0; r < R; r++) {
+    for (int q = 0; q < Q; q++) {
+      s[r][q] = _mm256_setzero_ps();
+    }
+  }
+  int64_t l = 0;
+  for (; l + 8 <= n; l += 8) {
+    __m256 yq[Q];
+    for (int q = 0; q < Q; q++) {
+      yq[q] = _mm256_loadu_ps(y[q] + l);
+    }
+    for (int r = 0; r < R; r++) {
+      __m256 xr = _mm256_loadu_ps(x[r] + l);
+      for (int q = 0; q < Q; q++) {
+        s[r][q] = _mm256_fmadd_ps(xr, yq[q], s[r][q]);
+      }
+    }
+  }
+  for (int r = 0; r < R; r++) {
+    for (int q = 0; q < Q; q++) {
+      real d = hsum256(s[r][q]);
+      for (int64_t t = l; t < n; t++) {
+        d += x[r][t] * y[q][t];
+      }
+      c[r * p + q] = d;
+    }
+  }
+}
+
+template <int R>
+__attribute__((target("avx2,fma"))) void dotRowsAvx2(
+    const real* const* x,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  int64_t j = 0;
+  for (; j + 2 <= p; j += 2) {
+    dotTileAvx2<R, 2>(x, y + j, p, n, c + j);
+  }
+  if (j < p) {
+    dotTileAvx2<R, 1>(x, y + j, p, n, c + j);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void dotBlockAvx2(
+    const real* const* x,
+    int64_t m,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  int64_t i = 0;
+  for (; i + 4 <= m; i += 4) {
+    dotRowsAvx2<4>(x + i, y, p, n, c + i * p);
+  }
+  switch (m - i) {
+    case 3:
+      dotRowsAvx2<3>(x + i, y, p, n, c + i * p);
+      break;
+    case 2:
+      dotRowsAvx2<2>(x + i, y, p, n, c + i * p);
+      break;
+    case 1:
+      dotRowsAvx2<1>(x + i, y, p, n, c + i * p);
+      break;
+  }
+}
+
+// R rows of y updated per pass over n: each chunk of y is loaded and
+// stored once, and each chunk of x[j] is read once for all R rows.
+template <int R>
+__attribute__((target("avx2,fma"))) void axpyRowsAvx2(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t n) {
+  int64_t l = 0;
+  for (; l + 8 <= n; l += 8) {
+    __m256 acc[R];
+    for (int r = 0; r < R; r++) {
+      acc[r] = _mm256_loadu_ps(y[r] + l);
+    }
+    for (int64_t j = 0; j < p; j++) {
+      __m256 xj = _mm256_loadu_ps(x[j] + l);
+      for (int r = 0; r < R; r++) {
+        acc[r] = _mm256_fmadd_ps(_mm256_set1_ps(a[r * p + j]), xj, acc[r]);
+      }
+    }
+    for (int r = 0; r < R; r++) {
+      _mm256_storeu_ps(y[r] + l, acc[r]);
+    }
+  }
+  for (; l < n; l++) {
+    for (int r = 0; r < R; r++) {
+      real d = y[r][l];
+      for (int64_t j = 0; j < p; j++) {
+        d += a[r * p + j] * x[j][l];
+      }
+      y[r][l] = d;
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) void axpyBlockAvx2(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t m,
+    int64_t n) {
+  int64_t i = 0;
+  for (; i + 4 <= m; i += 4) {
+    axpyRowsAvx2<4>(a + i * p, x, p, y + i, n);
+  }
+  switch (m - i) {
+    case 3:
+      axpyRowsAvx2<3>(a + i * p, x, p, y + i, n);
+      break;
+    case 2:
+      axpyRowsAvx2<2>(a + i * p, x, p, y + i, n);
+      break;
+    case 1:
+      axpyRowsAvx2<1>(a + i * p, x, p, y + i, n);
+      break;
+  }
+}
+
+// GCC's AVX-512 headers build their "undefined" operands as `__Y = __Y`,
+// which -Wuninitialized reports wherever they are inlined.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+__attribute__((target("avx512f"))) inline real hsum512(__m512 v) {
+  v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, 0x4e));
+  v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, 0xb1));
+  __m128 lo = _mm512_castps512_ps128(v);
+  lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+  lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+  return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx512f"))) real
+dotAvx512(const real* x, const real* y, int64_t n) {
+  __m512 s0 = _mm512_setzero_ps();
+  __m512 s1 = _mm512_setzero_ps();
+  int64_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), s0);
+    s1 = _mm512_fmadd_ps(
+        _mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16), s1);
+  }
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), s0);
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    s1 = _mm512_fmadd_ps(
+        _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i), s1);
+  }
+  return hsum512(_mm512_add_ps(s0, s1));
+}
+
+__attribute__((target("avx512f"))) void
+axpyAvx512(real a, const real* x, real* y, int64_t n) {
+  __m512 va = _mm512_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(
+        y + i,
+        _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    _mm512_mask_storeu_ps(
+        y + i,
+        m,
+        _mm512_fmadd_ps(
+            va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void
+scaleAvx512(real a, real* x, int64_t n) {
+  __m512 va = _mm512_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(x + i, _mm512_mul_ps(va, _mm512_loadu_ps(x + i)));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    _mm512_mask_storeu_ps(
+        x + i, m, _mm512_mul_ps(va, _mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) real
+sqnormAvx512(const real* x, int64_t n) {
+  return dotAvx512(x, x, n);
+}
+
+// the masked 256-bit loads are AVX512VL
+__attribute__((target("avx512f,avx512bw,avx512vl"))) int32_t
+dotInt8Avx512(const int8_t* x, const int8_t* y, int64_t n) {
+  __m512i s = _mm512_setzero_si512();
+  int64_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m512i a = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)(x + i)));
+    __m512i b = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)(y + i)));
+    s = _mm512_add_epi32(s, _mm512_madd_epi16(a, b));
+  }
+  if (i < n) {
+    __mmask32 m = __mmask32((uint64_t(1) << (n - i)) - 1);
+    __m512i a = _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(m, x + i));
+    __m512i b = _mm512_cvtepi8_epi16(_mm256_maskz_loadu_epi8(m, y + i));
+    s = _mm512_add_epi32(s, _mm512_madd_epi16(a, b));
+  }
+  __m256i h = _mm256_add_epi32(
+      _mm512_castsi512_si256(s), _mm512_extracti64x4_epi64(s, 1));
+  __m128i l = _mm_add_epi32(
+      _mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+  l = _mm_add_epi32(l, _mm_shuffle_epi32(l, 0x4e));
+  l = _mm_add_epi32(l, _mm_shuffle_epi32(l, 0xb1));
+  return _mm_cvtsi128_si32(l);
+}
+
+__attribute__((target("avx2,fma"))) void
+bf16ToFloatAvx2(const uint16_t* x, real* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i h = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(x + i)));
+    _mm256_storeu_ps(y + i, _mm256_castsi256_ps(_mm256_slli_epi32(h, 16)));
+  }
+  for (; i < n; i++) {
+    y[i] = bf16ToFloat1(x[i]);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void
+floatToBf16Avx2(const real* x, uint16_t* y, int64_t n) {
+  const __m256i bias = _mm256_set1_epi32(0x7fff);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i quiet = _mm256_set1_epi32(0x40);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(x + i);
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), one);
+    __m256i r = _mm256_srli_epi32(
+        _mm256_add_epi32(bits, _mm256_add_epi32(bias, lsb)), 16);
+    __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+    r = _mm256_blendv_epi8(
+        r, _mm256_or_si256(_mm256_srli_epi32(bits, 16), quiet), nan);
+    // packus works per 128-bit lane, so gather the two low quadwords
+    r = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+    _mm_storeu_si128((__m128i*)(y + i), _mm256_castsi256_si128(r));
+  }
+  for (; i < n; i++) {
+    y[i] = floatToBf16_1(x[i]);
+  }
+}
+
+__attribute__((target("avx2,fma,f16c"))) void
+fp16ToFloatAvx2(const uint16_t* x, real* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        y + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x + i))));
+  }
+  for (; i < n; i++) {
+    y[i] = fp16ToFloat1(x[i]);
+  }
+}
+
+__attribute__((target("avx2,fma,f16c"))) void
+floatToFp16Avx2(const real* x, uint16_t* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(
+        (__m128i*)(y + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  for (; i < n; i++) {
+    y[i] = floatToFp16_1(x[i]);
+  }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) void
+bf16ToFloatAvx512(const uint16_t* x, real* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m512i h =
+        _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(x + i)));
+    _mm512_storeu_ps(y + i, _mm512_castsi512_ps(_mm512_slli_epi32(h, 16)));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    __m512i h = _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(m, x + i));
+    _mm512_mask_storeu_ps(y + i, m, _mm512_castsi512_ps(_mm512_slli_epi32(h, 16)));
+  }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) inline __m256i
+floatToBf16x16(__m512 v) {
+  __m512i bits = _mm512_castps_si512(v);
+  __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+  __m512i r = _mm512_srli_epi32(
+      _mm512_add_epi32(bits, _mm512_add_epi32(_mm512_set1_epi32(0x7fff), lsb)),
+      16);
+  r = _mm512_mask_or_epi32(
+      r,
+      _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q),
+      _mm512_srli_epi32(bits, 16),
+      _mm512_set1_epi32(0x40));
+  return _mm512_cvtepi32_epi16(r);
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) void
+floatToBf16Avx512(const real* x, uint16_t* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(
+        (__m256i*)(y + i), floatToBf16x16(_mm512_loadu_ps(x + i)));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    _mm256_mask_storeu_epi16(
+        y + i, m, floatToBf16x16(_mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) void
+fp16ToFloatAvx512(const uint16_t* x, real* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(
+        y + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(x + i))));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    _mm512_mask_storeu_ps(
+        y + i, m, _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl"))) void
+floatToFp16Avx512(const real* x, uint16_t* y, int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm256_storeu_si256(
+        (__m256i*)(y + i),
+        _mm512_cvtps_ph(_mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  if (i < n) {
+    __mmask16 m = __mmask16((1u << (n - i)) - 1);
+    _mm256_mask_storeu_epi16(
+        y + i,
+        m,
+        _mm512_cvtps_ph(
+            _mm512_maskz_loadu_ps(m, x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+}
+
+// As the AVX2 tiles, with the tail of n done by masked loads.
+template <int R, int Q>
+__attribute__((target("avx512f"))) void dotTileAvx512(
+    const real* const* x,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  __m512 s[R][Q];
+  for (int r = 0; r < R; r++) {
+    for (int q = 0; q < Q; q++) {
+      s[r][q] = _mm512_setzero_ps();
+    }
+  }
+  for (int64_t l = 0; l < n; l += 16) {
+    const __mmask16 m =
+        n - l >= 16 ? __mmask16(0xffff) : __mmask16((1u << (n - l)) - 1);
+    __m512 yq[Q];
+    for (int q = 0; q < Q; q++) {
+      yq[q] = _mm512_maskz_loadu_ps(m, y[q] + l);
+    }
+    for (int r = 0; r < R; r++) {
+      __m512 xr = _mm512_maskz_loadu_ps(m, x[r] + l);
+      for (int q = 0; q < Q; q++) {
+        s[r][q] = _mm512_fmadd_ps(xr, yq[q], s[r][q]);
+      }
+    }
+  }
+  for (int r = 0; r < R; r++) {
+    for (int q = 0; q < Q; q++) {
+      c[r * p + q] = hsum512(s[r][q]);
+    }
+  }
+}
+
+template <int R>
+__attribute__((target("avx512f"))) void dotRowsAvx512(
+    const real* const* x,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  int64_t j = 0;
+  for (; j + 2 <= p; j += 2) {
+    dotTileAvx512<R, 2>(x, y + j, p, n, c + j);
+  }
+  if (j < p) {
+    dotTileAvx512<R, 1>(x, y + j, p, n, c + j);
+  }
+}
+
+__attribute__((target("avx512f"))) void dotBlockAvx512(
+    const real* const* x,
+    int64_t m,
+    const real* const* y,
+    int64_t p,
+    int64_t n,
+    real* c) {
+  int64_t i = 0;
+  for (; i + 4 <= m; i += 4) {
+    dotRowsAvx512<4>(x + i, y, p, n, c + i * p);
+  }
+  switch (m - i) {
+    case 3:
+      dotRowsAvx512<3>(x + i, y, p, n, c + i * p);
+      break;
+    case 2:
+      dotRowsAvx512<2>(x + i, y, p, n, c + i * p);
+      break;
+    case 1:
+      dotRowsAvx512<1>(x + i, y, p, n, c + i * p);
+      break;
+  }
+}
+
+template <int R>
+__attribute__((target("avx512f"))) void axpyRowsAvx512(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t n) {
+  for (int64_t l = 0; l < n; l += 16) {
+    const __mmask16 m =
+        n - l >= 16 ? __mmask16(0xffff) : __mmask16((1u << (n - l)) - 1);
+    __m512 acc[R];
+    for (int r = 0; r < R; r++) {
+      acc[r] = _mm512_maskz_loadu_ps(m, y[r] + l);
+    }
+    for (int64_t j = 0; j < p; j++) {
+      __m512 xj = _mm512_maskz_loadu_ps(m, x[j] + l);
+      for (int r = 0; r < R; r++) {
+        acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(a[r * p + j]), xj, acc[r]);
+      }
+    }
+    for (int r = 0; r < R; r++) {
+      _mm512_mask_storeu_ps(y[r] + l, m, acc[r]);
+    }
+  }
+}
+
+__attribute__((target("avx512f"))) void axpyBlockAvx512(
+    const real* a,
+    const real* const* x,
+    int64_t p,
+    real* const* y,
+    int64_t m,
+    int64_t n) {
+  int64_t i = 0;
+  for (; i + 4 <= m; i += 4) {
+    axpyRowsAvx512<4>(a + i * p, x, p, y + i, n);
+  }
+  switch (m - i) {
+    case 3:
+      axpyRowsAvx512<3>(a + i * p, x, p, y + i, n);
+      break;
+    case 2:
+      axpyRowsAvx512<2>(a + i * p, x, p, y + i, n);
+      break;
+    case 1:
+      axpyRowsAvx512<1>(a + i * p, x, p, y + i, n);
+      break;
+  }
+}
+
+#pragma GCC diagnostic pop
+
+const KernelTable kSse42 = {"sse4.2",
+                            dotSse42,
+                            axpySse42,
+                            scaleSse42,
+                            sqnormSse42,
+                            dotInt8Sse42,
+                            bf16ToFloatScalar,
+                            floatToBf16Scalar,
+                            fp16ToFloatScalar,
+                            floatToFp16Scalar,
+                            dotBlockSse42,
+                            axpyBlockSse42};
+
+const KernelTable kAvx2 = {"avx2",
+                           dotAvx2,
+                           axpyAvx2,
+                           scaleAvx2,
+                           sqnormAvx2,
+                           dotInt8Avx2,
+                           bf16ToFloatAvx2,
+                           floatToBf16Avx2,
+                           fp16ToFloatAvx2,
+                           floatToFp16Avx2,
+                           dotBlockAvx2,
+                           axpyBlockAvx2};
+
+const KernelTable kAvx512 = {"avx512",
+                             dotAvx512,
+                             axpyAvx512,
+                             scaleAvx512,
+                             sqnormAvx512,
+                             dotInt8Avx512,
+                             bf16ToFloatAvx512,
+                             floatToBf16Avx512,
+                             fp16ToFloatAvx512,
+                             floatToFp16Avx512,
+                             dotBlockAvx512,
+                             axpyBlockAvx512};
+
+#endif
+
+std::vector<const KernelTable*> supported() {
+  std::vector<const KernelTable*> tables = {&kScalar};
+#ifdef FASTTEXT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    tables.push_back(&kSse42);
+  }
+  // every AVX2 CPU also has F16C, which the fp16 conversions use
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    tables.push_back(&kAvx2);
+  }
+  if (__builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512bw") &&
+      __builtin_cpu_supports("avx512vl")) {
+    tables.push_back(&kAvx512);
+  }
+#endif
+  return tables;
+}
+
+const KernelTable* find(const std::string& name) {
+  for (const KernelTable* table : supported()) {
+    if (name == table->name) {
+      return table;
+    }
+  }
+  return nullptr;
+}
+
+const KernelTable* detect() {
+  const char* forced = std::getenv("FASTTEXT_KERNELS");
+  if (forced != nullptr) {
+    const KernelTable* table = find(forced);
+    if (table != nullptr) {
+      return table;
+    }
+  }
+  return supported().back();
+}
+
+} // namespace
+
+namespace detail {
+const KernelTable* active = detect();
+}
+
+const KernelTable& scalar() {
+  return kScalar;
+}
+
+std::vector<std::string> available() {
+  std::vector<std::string> names;
+  for (const KernelTable* table : supported()) {
+    names.push_back(table->name);
+  }
+  return names;
+}
+
+bool select(const std::string& name) {
+  const KernelTable* table = find(name);
+  if (table == nullptr) {
+    return false;
+  }
+  detail::active = table;
+  return true;
+}
+
+} // namespace kernels
+
+} // namespace fasttext
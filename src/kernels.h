@@ -0,0 +1,84 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "real.h"
+
+namespace fasttext {
+
+namespace kernels {
+
+// Level-1 primitives behind Vector and DenseMatrix, and the two small
+// matrix products of the -sharedNeg window update. One table per
+// instruction set; the best one the CPU supports is picked at startup
+// unless FASTTEXT_KERNELS names another one.
+struct KernelTable {
+  const char* name;
+  // sum_i x[i] * y[i]
+  real (*dot)(const real* x, const real* y, int64_t n);
+  // y[i] += a * x[i]
+  void (*axpy)(real a, const real* x, real* y, int64_t n);
+  // x[i] *= a
+  void (*scale)(real a, real* x, int64_t n);
+  // sum_i x[i] * x[i]
+  real (*sqnorm)(const real* x, int64_t n);
+  // sum_i x[i] * y[i] over int8 codes, accumulated in int32
+  int32_t (*dotInt8)(const int8_t* x, const int8_t* y, int64_t n);
+  // Conversions between fp32 and the bit patterns of bf16 and fp16,
+  // rounding to nearest even.
+  void (*bf16ToFloat)(const uint16_t* x, real* y, int64_t n);
+  void (*floatToBf16)(const real* x, uint16_t* y, int64_t n);
+  void (*fp16ToFloat)(const uint16_t* x, real* y, int64_t n);
+  void (*floatToFp16)(const real* x, uint16_t* y, int64_t n);
+  // Products over blocks of rows given by pointers, every row n long, so
+  // that rows gathered from a matrix need no packing. Register-blocked:
+  // each load of a row feeds several rows of the other operand.
+  // c[i * p + j] = sum_l x[i][l] * y[j][l], for i < m and j < p
+  void (*dotBlock)(
+      const real* const* x,
+      int64_t m,
+      const real* const* y,
+      int64_t p,
+      int64_t n,
+      real* c);
+  // y[i][l] += sum_j a[i * p + j] * x[j][l], for i < m and j < p
+  void (*axpyBlock)(
+      const real* a,
+      const real* const* x,
+      int64_t p,
+      real* const* y,
+      int64_t m,
+      int64_t n);
+};
+
+namespace detail {
+extern const KernelTable* active;
+}
+
+inline const KernelTable& get() {
+  return *detail::active;
+}
+
+// Plain C++ loops, kept as the reference for the vectorized tables.
+const KernelTable& scalar();
+
+// Names of the tables this binary and this CPU can run, best last.
+std::vector<std::string> available();
+
+// Switches the active table; returns false if the name is unknown or
+// not supported by this CPU. Not thread-safe with concurrent kernel calls.
+bool select(const std::string& name);
+
+} // namespace kernels
+
+} // namespace fasttext
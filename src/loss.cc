@@ -7,9 +7,12 @@
  */
 
 #include "loss.h"
+#include "kernels.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 namespace fasttext {
 
@@ -28,26 +31,118 @@ namespace fasttext {
         assert(targetIndex < targets.size());
         int32_t target = targets[targetIndex], secTarget = targets[secTargetIdex];
         real tmpLossSecond = 0.0, tmpLossFirst = 0.0;
-        state.outputVec.zero();state.outputVec.addRow(*wo_,target);
-        state.secOutVec.zero();state.secOutVec.addRow(*wo_,secTarget);
-        biLogiFirst(target, state, true, lr, backprop, tmpLossFirst);
-        biLogiSecond(target, secTarget, state, true, lr, backprop, tmpLossSecond);
+        biLogiPositive(target, secTarget, state, lr, backprop, tmpLossFirst, tmpLossSecond);
         for (int32_t n = 0; n < neg_; n++) {
-            auto negativeTarget = getNegative(target, state.rng);
-            state.outputVec.zero();state.outputVec.addRow(*wo_,negativeTarget);
+            auto negativeTarget = getNegative(target, state);
             biLogiFirst(negativeTarget, state, false, lr, backprop,tmpLossFirst);
         }
-        long long negOutId,secNegOutId;
+        int32_t negOutId,secNegOutId;
         for (int secNegI = 0; secNegI < neg_ % 2; secNegI++) { // second term's neg part
             for (int secNegJ = 0; secNegJ < neg_ % 2; secNegJ++) {
-                negOutId = getNegative(target,state.rng);
-                secNegOutId = getNegative(secTarget,state.rng);
-                state.outputVec.zero();state.outputVec.addRow(*wo_,negOutId,1.0);
-                state.secOutVec.zero();state.secOutVec.addRow(*wo_,secNegOutId,1.0);
+                negOutId = getNegative(target, state);
+                secNegOutId = getNegative(secTarget, state);
                 biLogiSecond(negOutId,secNegOutId,state, false, lr, backprop,tmpLossSecond);
             }
         }
         state.incrementLoss(tmpLossFirst,tmpLossSecond);
+        hotRowsUpdated(state);
+    }
+
+    // Window version of forward: the rows in state.windowHidden all share
+    // the positive target and one draw of negatives. The scores are the
+    // (inputs x outputs) product of the hidden block with the output block,
+    // and the input gradients and the summed output update are the
+    // products of the weights with the output and hidden blocks, each one
+    // call of the block kernels. The output rows are written back once.
+    void NegativeSamplingLoss::forwardWindow(
+            const std::vector<int32_t>& inputs,
+            int32_t target,
+            Model::State& state,
+            real lr) {
+        std::vector<int32_t>& outputs = state.windowOutputs;
+        outputs.clear();
+        outputs.push_back(target);
+        for (int32_t n = 0; n < neg_; n++) {
+            outputs.push_back(getNegative(target, state));
+        }
+        // Unlike forward, which draws the second word of the pair against
+        // secTarget (the input word), both are drawn against the target:
+        // the pair is shared by the whole window and each input has its
+        // own word. This is deliberate, and the only change to the
+        // distribution is that an input's own output row can come up as
+        // its second negative, at the rate it is drawn as any negative.
+        int32_t secNeg = neg_ % 2 ? outputs.size() : -1;
+        if (secNeg >= 0) { // second term's neg pair
+            outputs.push_back(getNegative(target, state));
+            outputs.push_back(getNegative(target, state));
+        }
+        const int64_t nin = inputs.size(), nout = outputs.size();
+        const int64_t dim = state.windowHidden[0].size();
+        for (int64_t i = 0; i < nout; i++) {
+            state.windowOutput[i].zero();
+            addOutputToVector(state.windowOutput[i], outputs[i], 1.0, state);
+            state.windowOutGrad[i].zero();
+        }
+        const kernels::KernelTable& kt = kernels::get();
+        real* scores = state.windowScores.data();
+        real* alpha = state.windowAlpha.data();
+        real* alphaT = state.windowAlphaT.data();
+        kt.dotBlock(
+                state.windowHiddenRows.data(), nin,
+                state.windowOutputRows.data(), nout, dim, scores);
+        real tmpLossSecond = 0.0, tmpLossFirst = 0.0;
+        for (int64_t j = 0; j < nin; j++) {
+            const Vector& hidden = state.windowHidden[j];
+            const real* score = scores + j * nout;
+            real* a = alpha + j * nout;
+            a[0] = binaryLogistic(score[0], true, tmpLossFirst);
+            for (int32_t n = 1; n <= neg_; n++) {
+                a[n] = binaryLogistic(score[n], false, tmpLossFirst);
+            }
+            // second term: the input's own output row joins the target
+            real selfInner = outputDot(hidden, inputs[j], state);
+            real selfAlpha = binaryLogistic(score[0] + selfInner, true, tmpLossSecond);
+            a[0] += selfAlpha;
+            if (secNeg >= 0) {
+                real secInner = score[secNeg] + score[secNeg + 1];
+                a[secNeg] = binaryLogistic(secInner, false, tmpLossSecond);
+                a[secNeg + 1] = a[secNeg];
+            }
+            for (int64_t i = 0; i < nout; i++) {
+                alphaT[i * nin + j] = a[i];
+                a[i] = -a[i];
+            }
+            addOutputToVector(state.windowGrad[j], inputs[j], -1 * selfAlpha, state);
+            addToOutput(hidden, inputs[j], lr * selfAlpha, state);
+        }
+        kt.axpyBlock(
+                alpha, state.windowOutputRows.data(), nout,
+                state.windowGradRows.data(), nin, dim);
+        kt.axpyBlock(
+                alphaT, state.windowHiddenRows.data(), nin,
+                state.windowOutGradRows.data(), nout, dim);
+        for (int64_t i = 0; i < nout; i++) {
+            addToOutput(state.windowOutGrad[i], outputs[i], lr, state);
+        }
+        state.incrementLoss(tmpLossFirst,tmpLossSecond);
+        hotRowsUpdated(state);
+    }
+
+    int32_t NegativeSamplingLoss::windowOutputs() const {
+        return 1 + neg_ + 2 * (neg_ % 2);
+    }
+
+    real BinaryLogisticLoss::binaryLogistic(
+            real inner,
+            bool labelIsPositive,
+            real& tmpLoss) const {
+        real score = sigmoid(inner);
+        if (labelIsPositive) {
+            tmpLoss += -log(score);
+        } else {
+            tmpLoss += -log(1.0 - score);
+        }
+        return real(labelIsPositive) - score;
     }
 
     void BinaryLogisticLoss::biLogiFirst(
@@ -57,69 +152,132 @@ namespace fasttext {
             real lr,
             bool backprop,
             real& tmpLossFirst) const {
-        real inner = state.inputVec.dotMul(state.outputVec,1.0);
-        real score = sigmoid(inner);
+        real inner = outputDot(state.inputVec, target, state);
+        real alpha = binaryLogistic(inner, labelIsPositive, tmpLossFirst);
         if (backprop) {
-            real alpha = (real(labelIsPositive) - score);
-//            state.outputVec.addVector(state.inputVec,-1 * inner);
-            state.inputGrad.addVector(state.outputVec, -1 * alpha);
-            wo_->addVectorToRow(state.inputVec, target, lr * alpha);
-        }
-        if (labelIsPositive) {
-            tmpLossFirst += -log(score);
-        } else {
-            tmpLossFirst += -log(1.0 - score);
+            addOutputToVector(state.inputGrad, target, -1 * alpha, state);
+            addToOutput(state.inputVec, target, lr * alpha, state);
         }
     }
 
     void BinaryLogisticLoss::biLogiSecond(int32_t outId,int32_t secOutId,Model::State& state,bool labelIsPositive,
             real lr,bool backprop,real &tmpLossSecond) const {
-        state.sumOutVec.zero();
-        state.sumOutVec.addVector(state.outputVec,1.0);
-        state.sumOutVec.addVector(state.secOutVec,1.0);
-        real inner = state.inputVec.dotMul(state.sumOutVec,1.0);
-        real score = sigmoid(inner);
+        real inner = outputDot(state.inputVec, outId, state) + outputDot(state.inputVec, secOutId, state);
+        real alpha = binaryLogistic(inner, labelIsPositive, tmpLossSecond);
         if (backprop) {
-            real alpha = (real(labelIsPositive) - score);
-//            state.sumOutVec.addVector(state.inputVec, -1 * inner);
-            state.inputGrad.addVector(state.sumOutVec, -1 * alpha);
-            wo_->addVectorToRow(state.inputVec, outId, lr * alpha);
-            wo_->addVectorToRow(state.inputVec, secOutId, lr * alpha);
+            addOutputToVector(state.inputGrad, outId, -1 * alpha, state);
+            addOutputToVector(state.inputGrad, secOutId, -1 * alpha, state);
+            addToOutput(state.inputVec, outId, lr * alpha, state);
+            addToOutput(state.inputVec, secOutId, lr * alpha, state);
         }
-        if (labelIsPositive) {
-            tmpLossSecond += -log(score);
-        } else {
-            tmpLossSecond += -log(1.0 - score);
+    }
+
+    void BinaryLogisticLoss::biLogiPositive(
+            int32_t target,
+            int32_t secTarget,
+            Model::State& state,
+            real lr,
+            bool backprop,
+            real& tmpLossFirst,
+            real& tmpLossSecond) const {
+        // both positive terms share the target row, so score and backprop
+        // them against the rows as they were before either update lands.
+        real inner = outputDot(state.inputVec, target, state);
+        real secInner = outputDot(state.inputVec, secTarget, state);
+        real alphaFirst = binaryLogistic(inner, true, tmpLossFirst);
+        real alphaSecond = binaryLogistic(inner + secInner, true, tmpLossSecond);
+        if (backprop) {
+            addOutputToVector(state.inputGrad, target, -1 * (alphaFirst + alphaSecond), state);
+            addOutputToVector(state.inputGrad, secTarget, -1 * alphaSecond, state);
+            addToOutput(state.inputVec, target, lr * (alphaFirst + alphaSecond), state);
+            addToOutput(state.inputVec, secTarget, lr * alphaSecond, state);
         }
     }
 
+    // The low half of the draw picks the slot, the high half is the coin.
+    int32_t NegativeSamplingLoss::sampleNegative(uint64_t draw) const {
+        const uint64_t slot = ((draw & 0xffffffffULL) * tableSize_) >> 32;
+        const AliasEntry& entry = table_[slot];
+        return uint32_t(draw >> 32) < entry.threshold ? int32_t(slot)
+                                                      : entry.alias;
+    }
+
+    void NegativeSamplingLoss::fillNegatives(Model::State& state) const {
+        state.negativeDraws.resize(NEGATIVE_BUFFER_SIZE);
+        state.negatives.resize(NEGATIVE_BUFFER_SIZE);
+        state.rng.fill(state.negativeDraws.data(), NEGATIVE_BUFFER_SIZE);
+        for (int32_t i = 0; i < NEGATIVE_BUFFER_SIZE; i++) {
+            state.negatives[i] = sampleNegative(state.negativeDraws[i]);
+        }
+        state.negativePos = 0;
+    }
+
     int32_t NegativeSamplingLoss::getNegative(
             int32_t target,
-            std::minstd_rand& rng) {
+            Model::State& state) const {
         int32_t negative;
         do {
-            negative = negatives_[uniform_(rng)];
+            if (state.negativePos == state.negatives.size()) {
+                fillNegatives(state);
+            }
+            negative = state.negatives[state.negativePos++];
         } while (target == negative);
         return negative;
     }
 
+    // Builds the alias table for P(i) ~ count_i^negPower with Vose's
+    // method: slots below the mean probability are topped up from one
+    // above it, which then goes back on the matching worklist.
     NegativeSamplingLoss::NegativeSamplingLoss(
             std::shared_ptr<Matrix>& wo,
             int neg,
+            real negPower,
             const std::vector<int64_t>& targetCounts)
-            : BinaryLogisticLoss(wo), neg_(neg), negatives_(), uniform_() {
-        real z = 0.0;
-        for (size_t i = 0; i < targetCounts.size(); i++) {
-            z += pow(targetCounts[i], 0.5);
-        }
-        for (size_t i = 0; i < targetCounts.size(); i++) {
-            real c = pow(targetCounts[i], 0.5);
-            for (size_t j = 0; j < c * NegativeSamplingLoss::NEGATIVE_TABLE_SIZE / z;
-                 j++) {
-                negatives_.push_back(i);
-            }
+            : BinaryLogisticLoss(wo),
+              neg_(neg),
+              aliases_(targetCounts.size()),
+              table_(aliases_.data()),
+              tableSize_(aliases_.size()) {
+        const int32_t n = targetCounts.size();
+        std::vector<double> p(n);
+        double z = 0.0;
+        for (int32_t i = 0; i < n; i++) {
+            p[i] = std::pow(double(targetCounts[i]), double(negPower));
+            z += p[i];
+        }
+        std::vector<int32_t> small, large;
+        for (int32_t i = 0; i < n; i++) {
+            p[i] *= n / z;
+            (p[i] < 1.0 ? small : large).push_back(i);
+        }
+        const double scale = double(uint64_t(1) << 32);
+        while (!small.empty() && !large.empty()) {
+            int32_t s = small.back(), l = large.back();
+            small.pop_back();
+            large.pop_back();
+            aliases_[s] = {uint32_t(std::min(p[s] * scale, scale - 1)), l};
+            p[l] -= 1.0 - p[s];
+            (p[l] < 1.0 ? small : large).push_back(l);
+        }
+        // whatever is left is 1 up to rounding error
+        for (int32_t i : small) {
+            aliases_[i] = {uint32_t(scale - 1), i};
+        }
+        for (int32_t i : large) {
+            aliases_[i] = {uint32_t(scale - 1), i};
         }
-        uniform_ = std::uniform_int_distribution<size_t>(0, negatives_.size() - 1);
+    }
+
+    int64_t NegativeSamplingLoss::tableBytes(int64_t n) {
+        return n * sizeof(AliasEntry);
+    }
+
+    void NegativeSamplingLoss::shareTable(char* memory, bool fill) {
+        if (fill) {
+            std::memcpy(memory, aliases_.data(), tableBytes(tableSize_));
+        }
+        table_ = reinterpret_cast<const AliasEntry*>(memory);
+        aliases_ = std::vector<AliasEntry>();
     }
 
     real Loss::log(real x) const {
@@ -142,10 +300,92 @@ namespace fasttext {
         }
     }
 
+    real Loss::outputDot(
+            const Vector& vec,
+            int32_t id,
+            Model::State& state) const {
+        if (id < hotRows_) {
+            return vec.dotMul(state.hotRows[id], 1.0);
+        }
+        return wo_->dotRow(vec, id);
+    }
+
+    void Loss::addOutputToVector(
+            Vector& vec,
+            int32_t id,
+            real a,
+            Model::State& state) const {
+        if (id < hotRows_) {
+            vec.addVector(state.hotRows[id], a);
+        } else {
+            vec.addRow(*wo_, id, a);
+        }
+    }
+
+    void Loss::addToOutput(
+            const Vector& vec,
+            int32_t id,
+            real a,
+            Model::State& state) const {
+        if (id < hotRows_) {
+            state.hotRows[id].addVector(vec, a);
+            state.hotDeltas[id].addVector(vec, a);
+            if (!state.hotDirty[id]) {
+                state.hotDirty[id] = 1;
+                state.hotDirtyRows.push_back(id);
+            }
+        } else {
+            wo_->addVectorToRow(vec, id, a);
+        }
+    }
+
+    void Loss::hotRowsUpdated(Model::State& state) const {
+        if (hotRows_ > 0 && ++state.hotUpdates >= hotSync_) {
+            syncHotRows(state);
+        }
+    }
+
+    void Loss::replicateHotRows(int32_t count, int32_t interval) {
+        hotRows_ = std::max(0, std::min(count, int32_t(wo_->size(0))));
+        hotSync_ = std::max(1, interval);
+    }
+
+    // Pushes the pending deltas of the rows written since the last merge
+    // and refreshes those copies, picking up what the other threads merged
+    // in the meantime. The first call takes copies of all hot rows.
+    void Loss::syncHotRows(Model::State& state) const {
+        if (hotRows_ == 0) {
+            return;
+        }
+        const int64_t dim = wo_->size(1);
+        if (state.hotRows.size() != size_t(hotRows_)) {
+            state.hotRows.assign(hotRows_, Vector(dim));
+            state.hotDeltas.assign(hotRows_, Vector(dim));
+            state.hotDirty.assign(hotRows_, 0);
+            state.hotDirtyRows.clear();
+            for (int32_t i = 0; i < hotRows_; i++) {
+                state.hotRows[i].zero();
+                state.hotRows[i].addRow(*wo_, i);
+                state.hotDeltas[i].zero();
+            }
+        }
+        for (int32_t i : state.hotDirtyRows) {
+            Vector& delta = state.hotDeltas[i];
+            wo_->addVectorToRow(delta, i, 1.0);
+            delta.zero();
+            state.hotRows[i].zero();
+            state.hotRows[i].addRow(*wo_, i);
+            state.hotDirty[i] = 0;
+        }
+        state.hotDirtyRows.clear();
+        state.hotUpdates = 0;
+    }
+
     BinaryLogisticLoss::BinaryLogisticLoss(std::shared_ptr<Matrix>& wo)
             : Loss(wo) {}
 
-    Loss::Loss(std::shared_ptr<Matrix>& wo) : wo_(wo) {
+    Loss::Loss(std::shared_ptr<Matrix>& wo)
+            : wo_(wo), hotRows_(0), hotSync_(1) {
         t_sigmoid_.reserve(SIGMOID_TABLE_SIZE + 1);
         for (int i = 0; i < SIGMOID_TABLE_SIZE + 1; i++) {
             real x = real(i * 2 * MAX_SIGMOID) / SIGMOID_TABLE_SIZE - MAX_SIGMOID;
@@ -27,14 +27,38 @@ namespace fasttext {
         std::vector<real> t_sigmoid_;
         std::vector<real> t_log_;
         std::shared_ptr<Matrix>& wo_;
+        int32_t hotRows_;
+        int32_t hotSync_;
 
         real log(real x) const;
         real sigmoid(real x) const;
 
+        // Output row access. Rows below hotRows_ are read from and written to
+        // the thread's copy in state; everything else goes to wo_.
+        real outputDot(const Vector& vec, int32_t id, Model::State& state) const;
+        void addOutputToVector(
+                Vector& vec,
+                int32_t id,
+                real a,
+                Model::State& state) const;
+        void addToOutput(
+                const Vector& vec,
+                int32_t id,
+                real a,
+                Model::State& state) const;
+        // counts one update and merges the hot rows every hotSync_ of them
+        void hotRowsUpdated(Model::State& state) const;
+
     public:
         explicit Loss(std::shared_ptr<Matrix>& wo);
         virtual ~Loss() = default;
 
+        // Keeps private per-thread copies of the first `count` output rows
+        // (the most frequent words) and merges the updates accumulated in
+        // them into the shared matrix every `interval` updates.
+        void replicateHotRows(int32_t count, int32_t interval);
+        void syncHotRows(Model::State& state) const;
+
         virtual void forward(
                 const std::vector<int32_t>& targets,
                 int32_t targetIndex,
@@ -42,10 +66,20 @@ namespace fasttext {
                 Model::State& state,
                 real lr,
                 bool backprop) = 0;
+
+        virtual void forwardWindow(
+                const std::vector<int32_t>& inputs,
+                int32_t target,
+                Model::State& state,
+                real lr) = 0;
+
+        virtual int32_t windowOutputs() const = 0;
     };
 
     class BinaryLogisticLoss : public Loss {
     protected:
+        real binaryLogistic(real inner, bool labelIsPositive, real& tmpLoss) const;
+
         void biLogiFirst(
                 int32_t target,
                 Model::State& state,
@@ -63,6 +97,15 @@ namespace fasttext {
                 bool backprop,
                 real &tmpLossSecond) const;
 
+        void biLogiPositive(
+                int32_t target,
+                int32_t secTarget,
+                Model::State& state,
+                real lr,
+                bool backprop,
+                real& tmpLossFirst,
+                real& tmpLossSecond) const;
+
     public:
         explicit BinaryLogisticLoss(std::shared_ptr<Matrix>& wo);
         virtual ~BinaryLogisticLoss() noexcept override = default;
@@ -70,20 +113,38 @@ namespace fasttext {
 
     class NegativeSamplingLoss : public BinaryLogisticLoss {
     protected:
-        static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
+        static const int32_t NEGATIVE_BUFFER_SIZE = 4096;
+
+        // One slot of the alias table: slot i yields i when a 32-bit
+        // uniform draw is below threshold, and alias otherwise.
+        struct AliasEntry {
+            uint32_t threshold;
+            int32_t alias;
+        };
 
         int neg_;
-        std::vector<int32_t> negatives_;
-        std::uniform_int_distribution<size_t> uniform_;
-        int32_t getNegative(int32_t target, std::minstd_rand& rng);
+        std::vector<AliasEntry> aliases_;
+        // aliases_, or the copy in shared memory after shareTable()
+        const AliasEntry* table_;
+        int64_t tableSize_;
+        int32_t sampleNegative(uint64_t draw) const;
+        void fillNegatives(Model::State& state) const;
+        int32_t getNegative(int32_t target, Model::State& state) const;
 
     public:
         explicit NegativeSamplingLoss(
                 std::shared_ptr<Matrix>& wo,
                 int neg,
+                real negPower,
                 const std::vector<int64_t>& targetCounts);
         ~NegativeSamplingLoss() noexcept override = default;
 
+        // Size of the alias table over n targets. shareTable() moves the
+        // table to `memory`, copying it there when `fill` and otherwise
+        // using what another process built from the same counts.
+        static int64_t tableBytes(int64_t n);
+        void shareTable(char* memory, bool fill);
+
         void forward(
                 const std::vector<int32_t>& targets,
                 int32_t targetIndex,
@@ -91,6 +152,14 @@ namespace fasttext {
                 Model::State& state,
                 real lr,
                 bool backprop) override;
+
+        void forwardWindow(
+                const std::vector<int32_t>& inputs,
+                int32_t target,
+                Model::State& state,
+                real lr) override;
+
+        int32_t windowOutputs() const override;
     };
 
 } // namespace fasttext
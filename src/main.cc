@@ -6,9 +6,12 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <queue>
+#include <sstream>
 #include <stdexcept>
 #include "args.h"
 #include "fasttext.h"
@@ -31,6 +34,7 @@ void printUsage() {
             << "  print-sentence-vectors  print sentence vectors given a trained model\n"
             << "  print-ngrams            print ngrams given a trained model and word\n"
             << "  nn                      query for nearest neighbors\n"
+            << "  hnsw                    build an approximate nearest neighbor index\n"
             << "  analogies               query for analogies\n"
             << "  dump                    dump arguments,dictionary,input/output vectors\n"
             << std::endl;
@@ -40,11 +44,302 @@ void train(const std::vector<std::string> args) {
     Args a = Args();
     a.parseArgs(args);
     std::shared_ptr<FastText> fasttext = std::make_shared<FastText>();
-    fasttext->train(a);
+    try {
+        fasttext->train(a);
+    } catch (const FastText::TrainingInterrupted& e) {
+        std::cerr << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    fasttext->saveModel(a.output + ".bin");
     fasttext->saveVectors(a.output + ".vec");
     if (a.saveOutput) {
         fasttext->saveOutput(a.output + ".output");
     }
+    // so that a later -resume with this -output starts over
+    std::remove((a.output + ".ckpt").c_str());
+}
+
+void quantize(const std::vector<std::string>& args) {
+    Args a = Args();
+    if (args.size() < 3) {
+        a.printHelp();
+        exit(EXIT_FAILURE);
+    }
+    a.parseArgs(args);
+    FastText fasttext;
+    fasttext.loadModel(a.output + ".bin");
+    fasttext.quantize(a);
+    fasttext.saveModel(a.output + ".ftz");
+}
+
+void printDumpUsage() {
+    std::cout << "usage: fasttext dump <model> <option>\n\n"
+              << "  <model>      model filename\n"
+              << "  <option>     option from args,dict,input,output" << std::endl;
+}
+
+void dump(const std::vector<std::string>& args) {
+    if (args.size() < 4) {
+        printDumpUsage();
+        exit(EXIT_FAILURE);
+    }
+    std::string modelPath = args[2];
+    std::string option = args[3];
+    FastText fasttext;
+    fasttext.loadModel(modelPath);
+    if (option == "args") {
+        fasttext.getArgs()->dump(std::cout);
+    } else if (option == "dict") {
+        fasttext.getDictionary()->dump(std::cout);
+    } else if (option == "input") {
+        fasttext.getInputMatrix()->dump(std::cout);
+    } else if (option == "output") {
+        fasttext.getOutputMatrix()->dump(std::cout);
+    } else {
+        printDumpUsage();
+        exit(EXIT_FAILURE);
+    }
+}
+
+std::string indexPath(const std::string& modelPath) {
+    const std::string suffix(".bin");
+    if (modelPath.size() > suffix.size() &&
+        modelPath.compare(modelPath.size() - suffix.size(), suffix.size(), suffix) == 0) {
+        return modelPath.substr(0, modelPath.size() - suffix.size()) + ".hnsw";
+    }
+    return modelPath + ".hnsw";
+}
+
+void printNNUsage() {
+    std::cout << "usage: fasttext nn <model> <k> [<queries>] [-int8] [-ef <ef>]\n\n"
+              << "  <model>      model filename\n"
+              << "  <k>          (optional; 10 by default) number of neighbors\n"
+              << "  <queries>    (optional) file of query words, one per line;\n"
+              << "               queries are read interactively otherwise\n"
+              << "  -int8        prescore with int8 codes, then rerank exactly\n"
+              << "  -ef          search the HNSW index next to the model instead,\n"
+              << "               with a candidate list of this size"
+              << std::endl;
+}
+
+void printHnswUsage() {
+    std::cout << "usage: fasttext hnsw <model> [<M>] [<efConstruction>]\n\n"
+              << "  <model>           model filename\n"
+              << "  <M>               (optional; 16 by default) links per node\n"
+              << "  <efConstruction>  (optional; 200 by default) candidate list size\n"
+              << "                    while building\n\n"
+              << "The index is written next to the model, with extension .hnsw"
+              << std::endl;
+}
+
+void hnsw(const std::vector<std::string>& args) {
+    if (args.size() < 3 || args.size() > 5) {
+        printHnswUsage();
+        exit(EXIT_FAILURE);
+    }
+    int32_t M = args.size() > 3 ? std::stoi(args[3]) : 16;
+    int32_t efConstruction = args.size() > 4 ? std::stoi(args[4]) : 200;
+    FastText fasttext;
+    fasttext.loadModel(args[2]);
+    fasttext.buildIndex(M, efConstruction);
+    fasttext.saveIndex(indexPath(args[2]));
+}
+
+void printNeighbors(
+        const std::string& word,
+        const std::vector<std::pair<real, std::string>>& neighbors,
+        bool withWord) {
+    for (const auto& neighbor : neighbors) {
+        if (withWord) {
+            std::cout << word << " ";
+        }
+        std::cout << neighbor.second << " " << neighbor.first << "\n";
+    }
+}
+
+void nn(const std::vector<std::string>& args) {
+    std::vector<std::string> positional;
+    bool int8 = false;
+    int32_t ef = 0;
+    for (size_t i = 2; i < args.size(); i++) {
+        if (args[i] == "-int8") {
+            int8 = true;
+        } else if (args[i] == "-ef" && i + 1 < args.size()) {
+            ef = std::stoi(args[++i]);
+        } else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.empty() || positional.size() > 3) {
+        printNNUsage();
+        exit(EXIT_FAILURE);
+    }
+    int32_t k = positional.size() > 1 ? std::stoi(positional[1]) : 10;
+    if (k <= 0) {
+        printNNUsage();
+        exit(EXIT_FAILURE);
+    }
+    FastText fasttext;
+    fasttext.loadModel(positional[0]);
+    if (ef > 0) {
+        fasttext.loadIndex(indexPath(positional[0]));
+    }
+    auto query = [&](const std::vector<std::string>& words) {
+        return ef > 0 ? fasttext.getApproxNN(words, k, ef)
+                      : fasttext.getNN(words, k, int8);
+    };
+
+    if (positional.size() < 3) {
+        std::string prompt("Query word? ");
+        std::cout << prompt;
+        std::string queryWord;
+        while (std::cin >> queryWord) {
+            printNeighbors(queryWord, query({queryWord})[0], false);
+            std::cout << prompt << std::flush;
+        }
+        return;
+    }
+
+    std::ifstream ifs(positional[2]);
+    if (!ifs.is_open()) {
+        std::cerr << "Queries file cannot be opened!" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const size_t batchSize = 1024;
+    std::vector<std::string> batch;
+    std::string queryWord;
+    while (true) {
+        bool more = bool(ifs >> queryWord);
+        if (more) {
+            batch.push_back(queryWord);
+        }
+        if (batch.size() == batchSize || (!more && !batch.empty())) {
+            auto results = query(batch);
+            for (size_t i = 0; i < batch.size(); i++) {
+                printNeighbors(batch[i], results[i], true);
+            }
+            batch.clear();
+        }
+        if (!more) {
+            break;
+        }
+    }
+    std::cout << std::flush;
+}
+
+void printAnalogiesUsage() {
+    std::cout << "usage: fasttext analogies <model> <k> [<questions>] [-int8]\n\n"
+              << "  <model>      model filename\n"
+              << "  <k>          (optional; 10 by default) number of answers\n"
+              << "  <questions>  (optional) questions in the Google analogy format\n"
+              << "               (\": category\" headers, then \"a b c d\" lines);\n"
+              << "               prints the accuracy of the best answer per\n"
+              << "               category. Triplets are read interactively otherwise\n"
+              << "  -int8        prescore with int8 codes, then rerank exactly"
+              << std::endl;
+}
+
+void printAccuracy(const std::string& name, int64_t correct, int64_t total, int64_t skipped) {
+    std::cout << std::setw(32) << std::left << name << std::right << " "
+              << std::setw(7) << correct << " / " << std::setw(7) << total << "  "
+              << std::fixed << std::setprecision(2) << std::setw(6)
+              << (total ? 100.0 * correct / total : 0.0) << "%  "
+              << "(" << skipped << " skipped)" << std::endl;
+}
+
+void analogies(const std::vector<std::string>& args) {
+    std::vector<std::string> positional;
+    bool int8 = false;
+    for (size_t i = 2; i < args.size(); i++) {
+        if (args[i] == "-int8") {
+            int8 = true;
+        } else {
+            positional.push_back(args[i]);
+        }
+    }
+    if (positional.empty() || positional.size() > 3) {
+        printAnalogiesUsage();
+        exit(EXIT_FAILURE);
+    }
+    int32_t k = positional.size() > 1 ? std::stoi(positional[1]) : 10;
+    if (k <= 0) {
+        printAnalogiesUsage();
+        exit(EXIT_FAILURE);
+    }
+    FastText fasttext;
+    fasttext.loadModel(positional[0]);
+
+    if (positional.size() < 3) {
+        std::string prompt("Query triplet (A - B + C)? ");
+        std::cout << prompt;
+        std::string wordA, wordB, wordC;
+        while (std::cin >> wordA >> wordB >> wordC) {
+            printNeighbors(wordA, fasttext.getAnalogies({{wordB, wordA, wordC}}, k, int8)[0], false);
+            std::cout << prompt << std::flush;
+        }
+        return;
+    }
+
+    std::ifstream ifs(positional[2]);
+    if (!ifs.is_open()) {
+        std::cerr << "Questions file cannot be opened!" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> categories;
+    std::vector<int32_t> category;
+    std::vector<std::vector<std::string>> questions;
+    std::vector<std::string> answers;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (iss >> word) {
+            words.push_back(word);
+        }
+        if (words.empty()) {
+            continue;
+        }
+        if (words[0] == ":") {
+            categories.push_back(words.size() > 1 ? words[1] : "");
+        } else if (words.size() == 4) {
+            if (categories.empty()) {
+                categories.push_back("");
+            }
+            category.push_back(categories.size() - 1);
+            questions.push_back({words[0], words[1], words[2]});
+            answers.push_back(words[3]);
+        }
+    }
+
+    std::vector<int64_t> correct(categories.size()), total(categories.size()),
+            skipped(categories.size());
+    const size_t batchSize = 4096;
+    for (size_t begin = 0; begin < questions.size(); begin += batchSize) {
+        size_t end = std::min(begin + batchSize, questions.size());
+        std::vector<std::vector<std::string>> batch(
+                questions.begin() + begin, questions.begin() + end);
+        auto results = fasttext.getAnalogies(batch, 1, int8);
+        for (size_t i = begin; i < end; i++) {
+            const auto& result = results[i - begin];
+            if (result.empty()) {
+                skipped[category[i]]++;
+                continue;
+            }
+            total[category[i]]++;
+            if (result[0].second == answers[i]) {
+                correct[category[i]]++;
+            }
+        }
+    }
+    int64_t allCorrect = 0, allTotal = 0, allSkipped = 0;
+    for (size_t c = 0; c < categories.size(); c++) {
+        printAccuracy(categories[c], correct[c], total[c], skipped[c]);
+        allCorrect += correct[c];
+        allTotal += total[c];
+        allSkipped += skipped[c];
+    }
+    printAccuracy("total", allCorrect, allTotal, allSkipped);
 }
 
 int main(int argc, char** argv) {
@@ -56,6 +351,16 @@ int main(int argc, char** argv) {
     std::string command(args[1]);
     if (command == "skipgram" || command == "cbow" || command == "supervised") {
         train(args);
+    } else if (command == "quantize") {
+        quantize(args);
+    } else if (command == "nn") {
+        nn(args);
+    } else if (command == "analogies") {
+        analogies(args);
+    } else if (command == "hnsw") {
+        hnsw(args);
+    } else if (command == "dump") {
+        dump(args);
     } else {
         printUsage();
         exit(EXIT_FAILURE);
@@ -27,16 +27,43 @@ namespace fasttext {
         grad.zero();
         loss_->forward(targets, targetIndex, secTargetIdex, state, lr, true);
         state.incrementNExamples();
-        /*riemannian gradient update*/
-        real projectScale = state.inputVec.dotMul(state.inputGrad,1.0);
-        Vector Z(wo_->size(1));
-        Z.zero();Z.addVector(state.inputGrad,1.0);
-        Z.addVector(state.inputVec,-1.0*projectScale);
-        Z.mul(-1.0 * lr);
-        wi_->addVectorToRow(Z,input,1.0);
+        /*riemannian gradient update, projected in place in the grad scratch*/
+        real projectScale = state.inputVec.dotMul(grad,1.0);
+        grad.addVector(state.inputVec,-1.0*projectScale);
+        wi_->addVectorToRow(grad,input,-1.0 * lr);
         wi_->scalerMulRow(1.0 / wi_->l2NormRow(input), input);
     }
 
+    // Shared-negative window update: every input of the window is scored
+    // against the same target and negatives in one block, and the output
+    // rows receive the summed update of the whole window.
+    void Model::updateWindow(
+            const std::vector<int32_t>& inputs,
+            int32_t target,
+            real lr,
+            State& state) {
+        if (state.windowHidden.size() < inputs.size()) {
+            state.reserveWindow(inputs.size(), loss_->windowOutputs());
+        }
+        for (size_t j = 0; j < inputs.size(); j++) {
+            Vector& hidden = state.windowHidden[j];
+            hidden.zero();
+            hidden.addRow(*wi_, inputs[j]);
+            hidden.mul(1.0/hidden.norm());
+            state.windowGrad[j].zero();
+        }
+        loss_->forwardWindow(inputs, target, state, lr);
+        for (size_t j = 0; j < inputs.size(); j++) {
+            Vector& hidden = state.windowHidden[j];
+            Vector& grad = state.windowGrad[j];
+            state.incrementNExamples();
+            real projectScale = hidden.dotMul(grad,1.0);
+            grad.addVector(hidden,-1.0*projectScale);
+            wi_->addVectorToRow(grad,inputs[j],-1.0 * lr);
+            wi_->scalerMulRow(1.0 / wi_->l2NormRow(inputs[j]), inputs[j]);
+        }
+    }
+
     void Model::computeHidden(const int32_t & input, State& state)
     const {
         Vector& hidden = state.inputVec;
@@ -45,6 +72,10 @@ namespace fasttext {
         hidden.mul(1.0/hidden.norm());
     }
 
+    void Model::syncHotRows(State& state) const {
+        loss_->syncHotRows(state);
+    }
+
     void Model::State::incrementNExamples() {
         nexamples_++;
     }
@@ -54,6 +85,31 @@ namespace fasttext {
         lossSecond_ += tmpLossSecond;
     }
 
+    void Model::State::reserveWindow(int32_t maxInputs, int32_t maxOutputs) {
+        int64_t dim = inputVec.size();
+        windowInputs.reserve(maxInputs);
+        windowOutputs.reserve(maxOutputs);
+        windowHidden.assign(maxInputs, Vector(dim));
+        windowGrad.assign(maxInputs, Vector(dim));
+        windowOutput.assign(maxOutputs, Vector(dim));
+        windowOutGrad.assign(maxOutputs, Vector(dim));
+        windowHiddenRows.resize(maxInputs);
+        windowGradRows.resize(maxInputs);
+        for (int32_t j = 0; j < maxInputs; j++) {
+            windowHiddenRows[j] = windowHidden[j].data();
+            windowGradRows[j] = windowGrad[j].data();
+        }
+        windowOutputRows.resize(maxOutputs);
+        windowOutGradRows.resize(maxOutputs);
+        for (int32_t i = 0; i < maxOutputs; i++) {
+            windowOutputRows[i] = windowOutput[i].data();
+            windowOutGradRows[i] = windowOutGrad[i].data();
+        }
+        windowScores.assign(maxInputs * maxOutputs, 0.0);
+        windowAlpha.assign(maxInputs * maxOutputs, 0.0);
+        windowAlphaT.assign(maxInputs * maxOutputs, 0.0);
+    }
+
     real Model::State::getFirstLoss() const {
         return lossFirst_ / nexamples_;
     }
@@ -62,16 +118,15 @@ namespace fasttext {
         return lossSecond_ / nexamples_;
     }
 
-    Model::State::State(int32_t hiddenSize, int32_t outputSize, int thread_id, int32_t seed)
+    Model::State::State(int32_t hiddenSize, int thread_id, int32_t seed)
             : lossFirst_(0.0),
               lossSecond_(0.0),
               nexamples_(0),
               inputGrad(hiddenSize),
               inputVec(hiddenSize),
-              outputVec(outputSize),
-              secOutVec(outputSize),
-              sumOutVec(outputSize),
-              rng(seed),
+              rng(seed, thread_id),
+              negativePos(0),
+              hotUpdates(0),
               thread_id(thread_id),
               inId(0),
               inNorm(0.0){}
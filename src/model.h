@@ -9,12 +9,12 @@
 #pragma once
 
 #include <memory>
-#include <random>
 #include <utility>
 #include <vector>
 
 #include "matrix.h"
 #include "real.h"
+#include "rng.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -49,15 +49,40 @@ namespace fasttext {
         public:
             Vector inputGrad;
             Vector inputVec;
-            Vector outputVec;
-            Vector secOutVec;
-            Vector sumOutVec;
-            std::minstd_rand rng;
+            std::vector<int32_t> windowInputs;
+            std::vector<int32_t> windowOutputs;
+            std::vector<Vector> windowHidden;
+            std::vector<Vector> windowGrad;
+            std::vector<Vector> windowOutput;
+            std::vector<Vector> windowOutGrad;
+            // the rows above as the block kernels take them
+            std::vector<real*> windowHiddenRows;
+            std::vector<real*> windowGradRows;
+            std::vector<real*> windowOutputRows;
+            std::vector<real*> windowOutGradRows;
+            // inputs x outputs scores and gradient weights, and the weights
+            // transposed for the output rows
+            std::vector<real> windowScores;
+            std::vector<real> windowAlpha;
+            std::vector<real> windowAlphaT;
+            Rng rng;
+            std::vector<uint64_t> negativeDraws;
+            std::vector<int32_t> negatives;
+            size_t negativePos;
+            // private copies of the hottest output rows (-hotRows), what was
+            // added to them since they were last merged and which ones that is
+            std::vector<Vector> hotRows;
+            std::vector<Vector> hotDeltas;
+            std::vector<uint8_t> hotDirty;
+            std::vector<int32_t> hotDirtyRows;
+            int64_t hotUpdates;
             int thread_id;
             long long inId;
             real inNorm;
 
-            State(int32_t hiddenSize, int32_t outputSize, int thread_id, int32_t seed);
+            // rng is stream thread_id of the generator seeded with seed
+            State(int32_t hiddenSize, int thread_id, int32_t seed);
+            void reserveWindow(int32_t maxInputs, int32_t maxOutputs);
             real getFirstLoss() const;
             real getSecondLoss() const;
             void incrementNExamples();
@@ -71,6 +96,13 @@ namespace fasttext {
                 int32_t secTargetIdex,
                 real lr,
                 State& state);
+        void updateWindow(
+                const std::vector<int32_t>& inputs,
+                int32_t target,
+                real lr,
+                State& state);
         void computeHidden(const int32_t & input, State& state) const;
+        // merges the thread's pending hot row updates into the output matrix
+        void syncHotRows(State& state) const;
     };
 } // namespace fasttext
@@ -0,0 +1,243 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "neighbors.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#include "kernels.h"
+
+namespace fasttext {
+
+namespace {
+
+typedef NearestNeighbors::Neighbor Neighbor;
+
+// Min-heap on the score so that the worst kept neighbour is on top.
+inline void pushBounded(std::vector<Neighbor>& heap, size_t k, real score, int32_t id) {
+  if (heap.size() < k) {
+    heap.push_back(Neighbor(score, id));
+    std::push_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+  } else if (score > heap.front().first) {
+    std::pop_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+    heap.back() = Neighbor(score, id);
+    std::push_heap(heap.begin(), heap.end(), std::greater<Neighbor>());
+  }
+}
+
+inline bool excluded(const std::vector<int32_t>& ids, int32_t id) {
+  return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+template <typename F>
+void parallelFor(int32_t nthreads, F f) {
+  std::vector<std::thread> threads;
+  for (int32_t t = 1; t < nthreads; t++) {
+    threads.push_back(std::thread([=]() { f(t); }));
+  }
+  f(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+NearestNeighbors::NearestNeighbors(
+    std::shared_ptr<const DenseMatrix> matrix,
+    int32_t nthreads)
+    : matrix_(matrix),
+      rows_(matrix->rows()),
+      cols_(matrix->cols()),
+      nthreads_(std::max(nthreads, 1)) {}
+
+NearestNeighbors::NearestNeighbors(
+    std::shared_ptr<const QuantMatrix> matrix,
+    int32_t nthreads)
+    : quant_(matrix),
+      rows_(matrix->size(0)),
+      cols_(matrix->size(1)),
+      nthreads_(std::max(nthreads, 1)) {}
+
+real NearestNeighbors::quantizeRow(const real* x, int64_t n, int8_t* codes) {
+  real amax = 0.0;
+  for (int64_t j = 0; j < n; j++) {
+    amax = std::max(amax, std::abs(x[j]));
+  }
+  real scale = amax > 0 ? amax / 127.0 : 1.0;
+  for (int64_t j = 0; j < n; j++) {
+    codes[j] = int8_t(std::lround(x[j] / scale));
+  }
+  return scale;
+}
+
+void NearestNeighbors::buildInt8() {
+  if (!matrix_) {
+    return;
+  }
+  const int64_t m = rows_, n = cols_;
+  codes_.resize(m * n);
+  scales_.resize(m);
+  parallelFor(nthreads_, [&](int32_t t) {
+    for (int64_t i = t * m / nthreads_; i < (t + 1) * m / nthreads_; i++) {
+      scales_[i] = quantizeRow(matrix_->row(i), n, codes_.data() + i * n);
+    }
+  });
+}
+
+bool NearestNeighbors::hasInt8() const {
+  return !scales_.empty();
+}
+
+void NearestNeighbors::searchRange(
+    const DenseMatrix& queries,
+    const std::vector<int8_t>& queryCodes,
+    const std::vector<real>& queryScales,
+    int32_t k,
+    const std::vector<std::vector<int32_t>>& exclude,
+    int64_t begin,
+    int64_t end,
+    std::vector<std::vector<Neighbor>>& heaps) const {
+  const kernels::KernelTable& kt = kernels::get();
+  const int64_t n = cols_;
+  const int64_t nq = queries.rows();
+  const bool int8 = !queryScales.empty();
+  for (int64_t rb = begin; rb < end; rb += BLOCK_ROWS) {
+    const int64_t re = std::min(rb + BLOCK_ROWS, end);
+    for (int64_t q = 0; q < nq; q++) {
+      std::vector<Neighbor>& heap = heaps[q];
+      for (int64_t i = rb; i < re; i++) {
+        real score;
+        if (int8) {
+          score = kt.dotInt8(codes_.data() + i * n, queryCodes.data() + q * n, n) *
+              scales_[i] * queryScales[q];
+        } else {
+          score = kt.dot(matrix_->row(i), queries.row(q), n);
+        }
+        if ((heap.size() < size_t(k) || score > heap.front().first) &&
+            !excluded(exclude[q], i)) {
+          pushBounded(heap, k, score, i);
+        }
+      }
+    }
+  }
+}
+
+void NearestNeighbors::searchRangeQuant(
+    const std::vector<real>& tables,
+    int64_t qbegin,
+    int64_t qend,
+    int32_t k,
+    const std::vector<std::vector<int32_t>>& exclude,
+    int64_t begin,
+    int64_t end,
+    std::vector<std::vector<Neighbor>>& heaps) const {
+  const int64_t tableSize = quant_->tableSize();
+  real scores[BLOCK_ROWS];
+  for (int64_t rb = begin; rb < end; rb += BLOCK_ROWS) {
+    const int64_t re = std::min(rb + BLOCK_ROWS, end);
+    for (int64_t q = qbegin; q < qend; q++) {
+      std::vector<Neighbor>& heap = heaps[q];
+      quant_->adcRows(tables.data() + (q - qbegin) * tableSize, rb, re, scores);
+      for (int64_t i = rb; i < re; i++) {
+        real score = scores[i - rb];
+        if ((heap.size() < size_t(k) || score > heap.front().first) &&
+            !excluded(exclude[q], i)) {
+          pushBounded(heap, k, score, i);
+        }
+      }
+    }
+  }
+}
+
+std::vector<std::vector<NearestNeighbors::Neighbor>> NearestNeighbors::search(
+    const DenseMatrix& queries,
+    int32_t k,
+    const std::vector<std::vector<int32_t>>& exclude,
+    int32_t candidates) const {
+  const int64_t m = rows_, n = cols_;
+  const int64_t nq = queries.rows();
+  if (queries.cols() != n || int64_t(exclude.size()) != nq) {
+    throw std::invalid_argument("Query batch does not match the matrix!");
+  }
+  if (k <= 0) {
+    return std::vector<std::vector<Neighbor>>(nq);
+  }
+  const int64_t nblocks = (m + BLOCK_ROWS - 1) / BLOCK_ROWS;
+  const int32_t nthreads = std::max<int64_t>(1, std::min<int64_t>(nthreads_, nblocks));
+  std::vector<std::vector<std::vector<Neighbor>>> heaps(
+      nthreads, std::vector<std::vector<Neighbor>>(nq));
+  auto rangeBegin = [&](int32_t t) { return t * nblocks / nthreads * BLOCK_ROWS; };
+  auto rangeEnd = [&](int32_t t) {
+    return std::min(m, (t + 1) * nblocks / nthreads * BLOCK_ROWS);
+  };
+
+  if (quant_) {
+    const int64_t tableSize = quant_->tableSize();
+    std::vector<real> tables(ADC_BATCH * tableSize);
+    for (int64_t qb = 0; qb < nq; qb += ADC_BATCH) {
+      const int64_t qe = std::min(qb + ADC_BATCH, nq);
+      for (int64_t q = qb; q < qe; q++) {
+        quant_->computeTable(queries.row(q), tables.data() + (q - qb) * tableSize);
+      }
+      parallelFor(nthreads, [&](int32_t t) {
+        searchRangeQuant(tables, qb, qe, k, exclude, rangeBegin(t), rangeEnd(t), heaps[t]);
+      });
+    }
+    std::vector<std::vector<Neighbor>> results(nq);
+    for (int64_t q = 0; q < nq; q++) {
+      for (int32_t t = 0; t < nthreads; t++) {
+        for (const Neighbor& neighbor : heaps[t][q]) {
+          pushBounded(results[q], k, neighbor.first, neighbor.second);
+        }
+      }
+      std::sort_heap(results[q].begin(), results[q].end(), std::greater<Neighbor>());
+    }
+    return results;
+  }
+
+  const bool int8 = candidates > 0 && hasInt8();
+  const int32_t kept = int8 ? std::max(candidates, k) : k;
+
+  std::vector<int8_t> queryCodes;
+  std::vector<real> queryScales;
+  if (int8) {
+    queryCodes.resize(nq * n);
+    queryScales.resize(nq);
+    for (int64_t q = 0; q < nq; q++) {
+      queryScales[q] = quantizeRow(queries.row(q), n, queryCodes.data() + q * n);
+    }
+  }
+
+  parallelFor(nthreads, [&](int32_t t) {
+    searchRange(
+        queries, queryCodes, queryScales, kept, exclude, rangeBegin(t), rangeEnd(t), heaps[t]);
+  });
+
+  const kernels::KernelTable& kt = kernels::get();
+  std::vector<std::vector<Neighbor>> results(nq);
+  for (int64_t q = 0; q < nq; q++) {
+    std::vector<Neighbor>& merged = results[q];
+    for (int32_t t = 0; t < nthreads; t++) {
+      for (const Neighbor& neighbor : heaps[t][q]) {
+        real score = int8
+            ? kt.dot(matrix_->row(neighbor.second), queries.row(q), n)
+            : neighbor.first;
+        pushBounded(merged, k, score, neighbor.second);
+      }
+    }
+    std::sort_heap(merged.begin(), merged.end(), std::greater<Neighbor>());
+  }
+  return results;
+}
+
+} // namespace fasttext
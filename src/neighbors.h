@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "densematrix.h"
+#include "quantmatrix.h"
+#include "real.h"
+
+namespace fasttext {
+
+// Exact maximum inner product search over the rows of a matrix. Trained
+// input rows are unit-norm, so the scores are cosine similarities.
+// A batch of queries walks the rows block by block so that each block is
+// read once from memory for all of them; the rows are split across
+// threads and every thread keeps a bounded min-heap per query.
+//
+// With buildInt8(), rows and queries can first be scored with int8 codes
+// (one scale per row) and only the best candidates rescored in float.
+// Over a QuantMatrix the rows are scored from their codes with one
+// asymmetric distance table per query.
+class NearestNeighbors {
+ public:
+  typedef std::pair<real, int32_t> Neighbor;
+
+  NearestNeighbors(std::shared_ptr<const DenseMatrix> matrix, int32_t nthreads);
+  NearestNeighbors(std::shared_ptr<const QuantMatrix> matrix, int32_t nthreads);
+
+  void buildInt8();
+  bool hasInt8() const;
+
+  // Returns the k best rows per query row, best first. Rows listed in
+  // exclude[q] are skipped for query q. If candidates > 0 and int8 codes
+  // are built, that many rows per query are kept by the int8 pass and
+  // reranked exactly.
+  std::vector<std::vector<Neighbor>> search(
+      const DenseMatrix& queries,
+      int32_t k,
+      const std::vector<std::vector<int32_t>>& exclude,
+      int32_t candidates = 0) const;
+
+ private:
+  static const int64_t BLOCK_ROWS = 128;
+  // queries whose distance tables are held at once
+  static const int64_t ADC_BATCH = 32;
+
+  std::shared_ptr<const DenseMatrix> matrix_;
+  std::shared_ptr<const QuantMatrix> quant_;
+  int64_t rows_;
+  int64_t cols_;
+  int32_t nthreads_;
+  std::vector<int8_t> codes_;
+  std::vector<real> scales_;
+
+  static real quantizeRow(const real* x, int64_t n, int8_t* codes);
+  void searchRange(
+      const DenseMatrix& queries,
+      const std::vector<int8_t>& queryCodes,
+      const std::vector<real>& queryScales,
+      int32_t k,
+      const std::vector<std::vector<int32_t>>& exclude,
+      int64_t begin,
+      int64_t end,
+      std::vector<std::vector<Neighbor>>& heaps) const;
+  void searchRangeQuant(
+      const std::vector<real>& tables,
+      int64_t qbegin,
+      int64_t qend,
+      int32_t k,
+      const std::vector<std::vector<int32_t>>& exclude,
+      int64_t begin,
+      int64_t end,
+      std::vector<std::vector<Neighbor>>& heaps) const;
+};
+
+} // namespace fasttext
@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "productquantizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace fasttext {
+
+namespace {
+
+const real EPS = 1e-7;
+
+template <typename F>
+void parallelFor(int32_t n, int32_t nthreads, F f) {
+  std::atomic<int32_t> next(0);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < std::max(1, std::min(nthreads, n)); t++) {
+    threads.push_back(std::thread([&]() {
+      for (int32_t i = next++; i < n; i = next++) {
+        f(i);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+} // namespace
+
+ProductQuantizer::ProductQuantizer()
+    : dim_(0), nsubq_(0), dsub_(0), lastdsub_(0) {}
+
+ProductQuantizer::ProductQuantizer(int32_t dim, int32_t dsub)
+    : dim_(dim),
+      nsubq_(dim / dsub),
+      dsub_(dsub),
+      lastdsub_(dim % dsub),
+      centroids_(dim * KSUB) {
+  if (lastdsub_ == 0) {
+    lastdsub_ = dsub_;
+  } else {
+    nsubq_++;
+  }
+}
+
+int32_t ProductQuantizer::ksub() {
+  return KSUB;
+}
+
+int32_t ProductQuantizer::nsubq() const {
+  return nsubq_;
+}
+
+real* ProductQuantizer::getCentroids(int32_t m, uint8_t i) {
+  if (m == nsubq_ - 1) {
+    return &centroids_[m * KSUB * dsub_ + i * lastdsub_];
+  }
+  return &centroids_[(m * KSUB + i) * dsub_];
+}
+
+real ProductQuantizer::distL2(const real* x, const real* y, int32_t d) const {
+  real dist = 0;
+  for (int32_t i = 0; i < d; i++) {
+    real tmp = x[i] - y[i];
+    dist += tmp * tmp;
+  }
+  return dist;
+}
+
+real ProductQuantizer::assignCentroid(
+    const real* x,
+    const real* c0,
+    uint8_t* code,
+    int32_t d) const {
+  const real* c = c0;
+  real dis = distL2(x, c, d);
+  code[0] = 0;
+  for (int32_t j = 1; j < KSUB; j++) {
+    c += d;
+    real disij = distL2(x, c, d);
+    if (disij < dis) {
+      code[0] = uint8_t(j);
+      dis = disij;
+    }
+  }
+  return dis;
+}
+
+void ProductQuantizer::Estep(
+    const real* x,
+    const real* centroids,
+    uint8_t* codes,
+    int32_t d,
+    int32_t n) const {
+  for (int32_t i = 0; i < n; i++) {
+    assignCentroid(x + i * d, centroids, codes + i, d);
+  }
+}
+
+// Empty clusters take over half of a large cluster: the centroid is
+// copied with a small symmetric perturbation.
+void ProductQuantizer::MStep(
+    const real* x0,
+    real* centroids,
+    const uint8_t* codes,
+    int32_t d,
+    int32_t n,
+    std::minstd_rand& rng) const {
+  std::vector<int32_t> nelts(KSUB, 0);
+  std::fill(centroids, centroids + d * KSUB, 0);
+  const real* x = x0;
+  for (int32_t i = 0; i < n; i++) {
+    int32_t k = codes[i];
+    real* c = centroids + k * d;
+    for (int32_t j = 0; j < d; j++) {
+      c[j] += x[j];
+    }
+    nelts[k]++;
+    x += d;
+  }
+
+  real* c = centroids;
+  for (int32_t k = 0; k < KSUB; k++) {
+    real z = (real)nelts[k];
+    if (z != 0) {
+      for (int32_t j = 0; j < d; j++) {
+        c[j] /= z;
+      }
+    }
+    c += d;
+  }
+
+  std::uniform_real_distribution<> uniform(0, 1);
+  for (int32_t k = 0; k < KSUB; k++) {
+    if (nelts[k] == 0) {
+      int32_t m = 0;
+      while (uniform(rng) * (n - KSUB) >= nelts[m] - 1) {
+        m = (m + 1) % KSUB;
+      }
+      std::memcpy(centroids + k * d, centroids + m * d, sizeof(real) * d);
+      for (int32_t j = 0; j < d; j++) {
+        int32_t sign = (j % 2) * 2 - 1;
+        centroids[k * d + j] += sign * EPS;
+        centroids[m * d + j] -= sign * EPS;
+      }
+      nelts[k] = nelts[m] / 2;
+      nelts[m] -= nelts[k];
+    }
+  }
+}
+
+void ProductQuantizer::kmeans(
+    const real* x,
+    real* c,
+    int32_t n,
+    int32_t d,
+    std::minstd_rand& rng) const {
+  std::vector<int32_t> perm(n, 0);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::shuffle(perm.begin(), perm.end(), rng);
+  for (int32_t i = 0; i < KSUB; i++) {
+    std::memcpy(&c[i * d], x + perm[i] * d, d * sizeof(real));
+  }
+  std::vector<uint8_t> codes(n);
+  for (int32_t i = 0; i < NITER; i++) {
+    Estep(x, c, codes.data(), d, n);
+    MStep(x, c, codes.data(), d, n, rng);
+  }
+}
+
+void ProductQuantizer::train(int32_t n, const real* x, int32_t nthreads) {
+  if (n < KSUB) {
+    throw std::invalid_argument(
+        "Matrix too small for quantization, must have at least " +
+        std::to_string(KSUB) + " rows");
+  }
+  const int32_t np = std::min(n, MAX_POINTS);
+  // every sub-quantizer draws its own sample, so they train independently
+  parallelFor(nsubq_, nthreads, [&](int32_t m) {
+    std::minstd_rand rng(SEED + m);
+    const int32_t d = m == nsubq_ - 1 ? lastdsub_ : dsub_;
+    std::vector<int32_t> perm(n, 0);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::shuffle(perm.begin(), perm.end(), rng);
+    std::vector<real> xslice(np * d);
+    for (int32_t j = 0; j < np; j++) {
+      std::memcpy(
+          xslice.data() + j * d,
+          x + int64_t(perm[j]) * dim_ + m * dsub_,
+          d * sizeof(real));
+    }
+    kmeans(xslice.data(), getCentroids(m, 0), np, d, rng);
+  });
+}
+
+void ProductQuantizer::computeCode(const real* x, uint8_t* code) const {
+  for (int32_t m = 0; m < nsubq_; m++) {
+    const int32_t d = m == nsubq_ - 1 ? lastdsub_ : dsub_;
+    assignCentroid(x + m * dsub_, getCentroids(m, 0), code + m, d);
+  }
+}
+
+void ProductQuantizer::computeCodes(
+    const real* x,
+    uint8_t* codes,
+    int32_t n,
+    int32_t nthreads) const {
+  const int32_t chunk = 4096;
+  parallelFor((n + chunk - 1) / chunk, nthreads, [&](int32_t c) {
+    for (int32_t i = c * chunk; i < std::min(n, (c + 1) * chunk); i++) {
+      computeCode(x + int64_t(i) * dim_, codes + int64_t(i) * nsubq_);
+    }
+  });
+}
+
+real ProductQuantizer::mulCode(
+    const Vector& x,
+    const uint8_t* codes,
+    int32_t t,
+    real alpha) const {
+  real res = 0.0;
+  const uint8_t* code = codes + int64_t(nsubq_) * t;
+  for (int32_t m = 0; m < nsubq_; m++) {
+    const real* c = getCentroids(m, code[m]);
+    const int32_t d = m == nsubq_ - 1 ? lastdsub_ : dsub_;
+    for (int32_t n = 0; n < d; n++) {
+      res += x[m * dsub_ + n] * c[n];
+    }
+  }
+  return res * alpha;
+}
+
+void ProductQuantizer::addCode(
+    Vector& x,
+    const uint8_t* codes,
+    int32_t t,
+    real alpha) const {
+  const uint8_t* code = codes + int64_t(nsubq_) * t;
+  for (int32_t m = 0; m < nsubq_; m++) {
+    const real* c = getCentroids(m, code[m]);
+    const int32_t d = m == nsubq_ - 1 ? lastdsub_ : dsub_;
+    for (int32_t n = 0; n < d; n++) {
+      x[m * dsub_ + n] += alpha * c[n];
+    }
+  }
+}
+
+int32_t ProductQuantizer::tableSize() const {
+  return nsubq_ * KSUB;
+}
+
+void ProductQuantizer::computeTable(const real* query, real* table) const {
+  for (int32_t m = 0; m < nsubq_; m++) {
+    const int32_t d = m == nsubq_ - 1 ? lastdsub_ : dsub_;
+    const real* q = query + m * dsub_;
+    for (int32_t i = 0; i < KSUB; i++) {
+      const real* c = getCentroids(m, i);
+      real dot = 0.0;
+      for (int32_t n = 0; n < d; n++) {
+        dot += q[n] * c[n];
+      }
+      table[m * KSUB + i] = dot;
+    }
+  }
+}
+
+void ProductQuantizer::adcBlock(
+    const real* table,
+    const uint8_t* codes,
+    int64_t begin,
+    int64_t end,
+    real* scores) const {
+  const int64_t n = end - begin;
+  std::fill(scores, scores + n, 0.0);
+  for (int32_t m = 0; m < nsubq_; m++) {
+    const real* t = table + m * KSUB;
+    const uint8_t* code = codes + begin * nsubq_ + m;
+    for (int64_t r = 0; r < n; r++) {
+      scores[r] += t[code[r * nsubq_]];
+    }
+  }
+}
+
+void ProductQuantizer::save(std::ostream& out) const {
+  out.write((char*)&dim_, sizeof(dim_));
+  out.write((char*)&nsubq_, sizeof(nsubq_));
+  out.write((char*)&dsub_, sizeof(dsub_));
+  out.write((char*)&lastdsub_, sizeof(lastdsub_));
+  out.write((char*)centroids_.data(), centroids_.size() * sizeof(real));
+}
+
+void ProductQuantizer::load(std::istream& in) {
+  in.read((char*)&dim_, sizeof(dim_));
+  in.read((char*)&nsubq_, sizeof(nsubq_));
+  in.read((char*)&dsub_, sizeof(dsub_));
+  in.read((char*)&lastdsub_, sizeof(lastdsub_));
+  if (!in || dim_ < 0 || nsubq_ < 0 || dsub_ <= 0) {
+    throw std::invalid_argument("Invalid product quantizer!");
+  }
+  centroids_.resize(dim_ * KSUB);
+  in.read((char*)centroids_.data(), centroids_.size() * sizeof(real));
+}
+
+} // namespace fasttext
@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <random>
+#include <vector>
+
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Product quantizer with 8-bit codes: vectors are cut into sub-vectors of
+// dsub dimensions (the last one may be shorter) and each sub-vector is
+// replaced by the index of its nearest centroid among 256 learned by
+// k-means on that slice.
+class ProductQuantizer {
+ protected:
+  static const int32_t NBITS = 8;
+  static const int32_t KSUB = 1 << NBITS;
+  static const int32_t MAX_POINTS_PER_CLUSTER = 256;
+  static const int32_t MAX_POINTS = MAX_POINTS_PER_CLUSTER * KSUB;
+  static const int32_t SEED = 1234;
+  static const int32_t NITER = 25;
+
+  int32_t dim_;
+  int32_t nsubq_;
+  int32_t dsub_;
+  int32_t lastdsub_;
+
+  std::vector<real> centroids_;
+
+  real distL2(const real*, const real*, int32_t) const;
+  real assignCentroid(const real*, const real*, uint8_t*, int32_t) const;
+  void Estep(const real*, const real*, uint8_t*, int32_t, int32_t) const;
+  void MStep(const real*, real*, const uint8_t*, int32_t, int32_t, std::minstd_rand&)
+      const;
+  void kmeans(const real*, real*, int32_t, int32_t, std::minstd_rand&) const;
+
+ public:
+  ProductQuantizer();
+  ProductQuantizer(int32_t dim, int32_t dsub);
+
+  static int32_t ksub();
+
+  int32_t nsubq() const;
+  real* getCentroids(int32_t m, uint8_t i);
+  inline const real* getCentroids(int32_t m, uint8_t i) const {
+    if (m == nsubq_ - 1) {
+      return &centroids_[m * KSUB * dsub_ + i * lastdsub_];
+    }
+    return &centroids_[(m * KSUB + i) * dsub_];
+  }
+
+  // Learns the codebooks from the n x dim_ rows of x, one k-means per
+  // sub-quantizer, spread over nthreads threads.
+  void train(int32_t n, const real* x, int32_t nthreads);
+  void computeCode(const real* x, uint8_t* code) const;
+  void computeCodes(const real* x, uint8_t* codes, int32_t n, int32_t nthreads)
+      const;
+
+  real mulCode(const Vector& x, const uint8_t* codes, int32_t t, real alpha) const;
+  void addCode(Vector& x, const uint8_t* codes, int32_t t, real alpha) const;
+
+  // Asymmetric distance computation: table[m * ksub() + i] holds the dot
+  // product of the query's m-th sub-vector with centroid i, so scoring a
+  // code is nsubq() lookups.
+  int32_t tableSize() const;
+  void computeTable(const real* query, real* table) const;
+  inline real adc(const real* table, const uint8_t* codes, int32_t t) const {
+    const uint8_t* code = codes + int64_t(nsubq_) * t;
+    real res = 0.0;
+    for (int32_t m = 0; m < nsubq_; m++) {
+      res += table[m * KSUB + code[m]];
+    }
+    return res;
+  }
+  // adc() for the codes of rows [begin, end), one sub-quantizer at a time
+  // so that only its slice of the table is hot.
+  void adcBlock(
+      const real* table,
+      const uint8_t* codes,
+      int64_t begin,
+      int64_t end,
+      real* scores) const;
+
+  void save(std::ostream&) const;
+  void load(std::istream&);
+};
+
+} // namespace fasttext
@@ -0,0 +1,149 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "quantmatrix.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace fasttext {
+
+QuantMatrix::QuantMatrix() : Matrix(), qnorm_(false), codesize_(0) {}
+
+QuantMatrix::QuantMatrix(
+    DenseMatrix&& mat,
+    int32_t dsub,
+    bool qnorm,
+    int32_t nthreads)
+    : Matrix(mat.size(0), mat.size(1)),
+      qnorm_(qnorm),
+      codesize_(0) {
+  if (mat.stride() != mat.cols()) {
+    throw std::invalid_argument("Quantization needs unpadded rows!");
+  }
+  pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer(n_, dsub));
+  codesize_ = m_ * pq_->nsubq();
+  codes_.resize(codesize_);
+  if (qnorm_) {
+    normCodes_.resize(m_);
+    Vector norms(m_);
+    mat.l2NormRow(norms);
+    mat.divideRow(norms);
+    npq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer(1, 1));
+    npq_->train(m_, norms.data(), nthreads);
+    npq_->computeCodes(norms.data(), normCodes_.data(), m_, nthreads);
+  }
+  pq_->train(m_, mat.data(), nthreads);
+  pq_->computeCodes(mat.data(), codes_.data(), m_, nthreads);
+}
+
+int32_t QuantMatrix::tableSize() const {
+  return pq_->tableSize();
+}
+
+void QuantMatrix::computeTable(const real* query, real* table) const {
+  pq_->computeTable(query, table);
+}
+
+void QuantMatrix::adcRows(
+    const real* table,
+    int64_t begin,
+    int64_t end,
+    real* scores) const {
+  pq_->adcBlock(table, codes_.data(), begin, end, scores);
+  if (qnorm_) {
+    for (int64_t i = begin; i < end; i++) {
+      scores[i - begin] *= rowNorm(i);
+    }
+  }
+}
+
+void QuantMatrix::scalerMulRow(real, int64_t) {
+  throw std::runtime_error("Operation not permitted on quantized matrices.");
+}
+
+real QuantMatrix::l2NormRow(int64_t i) const {
+  Vector x(n_);
+  x.zero();
+  addRowToVector(x, i);
+  return x.norm();
+}
+
+real QuantMatrix::dotRow(const Vector& vec, int64_t i) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(vec.size() == n_);
+  return pq_->mulCode(vec, codes_.data(), i, rowNorm(i));
+}
+
+void QuantMatrix::addVectorToRow(const Vector&, int64_t, real) {
+  throw std::runtime_error("Operation not permitted on quantized matrices.");
+}
+
+void QuantMatrix::addRowToVector(Vector& x, int32_t i) const {
+  pq_->addCode(x, codes_.data(), i, rowNorm(i));
+}
+
+void QuantMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
+  pq_->addCode(x, codes_.data(), i, a * rowNorm(i));
+}
+
+void QuantMatrix::save(std::ostream& out) const {
+  out.write((char*)&qnorm_, sizeof(qnorm_));
+  out.write((char*)&m_, sizeof(m_));
+  out.write((char*)&n_, sizeof(n_));
+  out.write((char*)&codesize_, sizeof(codesize_));
+  out.write((char*)codes_.data(), codesize_ * sizeof(uint8_t));
+  pq_->save(out);
+  if (qnorm_) {
+    out.write((char*)normCodes_.data(), m_ * sizeof(uint8_t));
+    npq_->save(out);
+  }
+}
+
+void QuantMatrix::load(std::istream& in) {
+  in.read((char*)&qnorm_, sizeof(qnorm_));
+  in.read((char*)&m_, sizeof(m_));
+  in.read((char*)&n_, sizeof(n_));
+  in.read((char*)&codesize_, sizeof(codesize_));
+  if (!in || m_ < 0 || n_ < 0 || codesize_ < 0) {
+    throw std::invalid_argument("Invalid quantized matrix!");
+  }
+  codes_ = std::vector<uint8_t>(codesize_);
+  in.read((char*)codes_.data(), codesize_ * sizeof(uint8_t));
+  pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer());
+  pq_->load(in);
+  if (qnorm_) {
+    normCodes_ = std::vector<uint8_t>(m_);
+    in.read((char*)normCodes_.data(), m_ * sizeof(uint8_t));
+    npq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer());
+    npq_->load(in);
+  }
+  if (!in) {
+    throw std::invalid_argument("Invalid quantized matrix!");
+  }
+}
+
+void QuantMatrix::dump(std::ostream& out) const {
+  out << m_ << " " << n_ << std::endl;
+  Vector x(n_);
+  for (int64_t i = 0; i < m_; i++) {
+    x.zero();
+    addRowToVector(x, i);
+    for (int64_t j = 0; j < n_; j++) {
+      if (j > 0) {
+        out << " ";
+      }
+      out << x[j];
+    }
+    out << std::endl;
+  }
+}
+
+} // namespace fasttext
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#include "densematrix.h"
+#include "matrix.h"
+#include "productquantizer.h"
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Read-only matrix stored as product quantization codes. With qnorm the
+// rows are normalized before quantization and their norms are kept with
+// a separate one-dimensional quantizer.
+class QuantMatrix : public Matrix {
+ protected:
+  std::unique_ptr<ProductQuantizer> pq_;
+  std::unique_ptr<ProductQuantizer> npq_;
+
+  std::vector<uint8_t> codes_;
+  std::vector<uint8_t> normCodes_;
+
+  bool qnorm_;
+  int32_t codesize_;
+
+ public:
+  QuantMatrix();
+  QuantMatrix(DenseMatrix&&, int32_t dsub, bool qnorm, int32_t nthreads);
+  QuantMatrix(QuantMatrix&&) = default;
+  QuantMatrix& operator=(QuantMatrix&&) = default;
+  QuantMatrix(const QuantMatrix&) = delete;
+  QuantMatrix& operator=(const QuantMatrix&) = delete;
+  virtual ~QuantMatrix() noexcept override = default;
+
+  inline real rowNorm(int64_t i) const {
+    return qnorm_ ? npq_->getCentroids(0, normCodes_[i])[0] : 1.0;
+  }
+
+  // See ProductQuantizer::computeTable; adcRow scores row i against the
+  // query the table was computed for.
+  int32_t tableSize() const;
+  void computeTable(const real* query, real* table) const;
+  inline real adcRow(const real* table, int64_t i) const {
+    return pq_->adc(table, codes_.data(), i) * rowNorm(i);
+  }
+  void adcRows(const real* table, int64_t begin, int64_t end, real* scores) const;
+
+  void scalerMulRow(real a, int64_t id) override;
+  real l2NormRow(int64_t i) const override;
+  real dotRow(const Vector&, int64_t) const override;
+  void addVectorToRow(const Vector&, int64_t, real) override;
+  void addRowToVector(Vector& x, int32_t i) const override;
+  void addRowToVector(Vector& x, int32_t i, real a) const override;
+  void save(std::ostream&) const override;
+  void load(std::istream&) override;
+  void dump(std::ostream&) const override;
+};
+
+} // namespace fasttext
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace fasttext {
+
+// xoshiro256** (Blackman and Vigna). The state is seeded with splitmix64
+// from `seed`; `stream` then jumps ahead by that many 2^128 steps, so the
+// streams of different threads never overlap. Satisfies the standard
+// UniformRandomBitGenerator requirements.
+class Rng {
+ public:
+  typedef uint64_t result_type;
+
+  explicit Rng(uint64_t seed = 0, uint64_t stream = 0) {
+    for (int i = 0; i < 4; i++) {
+      seed += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      s_[i] = z ^ (z >> 31);
+    }
+    for (uint64_t i = 0; i < stream; i++) {
+      jump();
+    }
+  }
+
+  static constexpr result_type min() {
+    return 0;
+  }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  inline uint64_t operator()() {
+    const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+  inline uint32_t next32() {
+    return uint32_t((*this)() >> 32);
+  }
+
+  // Uniform in [0, n) by multiply-shift; the bias is at most n / 2^32.
+  inline uint32_t uniform(uint32_t n) {
+    return uint32_t((uint64_t(next32()) * n) >> 32);
+  }
+
+  void fill(uint64_t* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      out[i] = (*this)();
+    }
+  }
+
+  void jump() {
+    static const uint64_t JUMP[] = {0x180ec6d33cfd0abaULL,
+                                    0xd5a61266f0c9392cULL,
+                                    0xa9582618e03fc9aaULL,
+                                    0x39abdc4529b1661cULL};
+    uint64_t s[4] = {0, 0, 0, 0};
+    for (int i = 0; i < 4; i++) {
+      for (int b = 0; b < 64; b++) {
+        if (JUMP[i] & (uint64_t(1) << b)) {
+          for (int j = 0; j < 4; j++) {
+            s[j] ^= s_[j];
+          }
+        }
+        (*this)();
+      }
+    }
+    for (int j = 0; j < 4; j++) {
+      s_[j] = s[j];
+    }
+  }
+
+ private:
+  static inline uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t s_[4];
+};
+
+} // namespace fasttext
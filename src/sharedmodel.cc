@@ -0,0 +1,210 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "sharedmodel.h"
+
+#include <signal.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+namespace fasttext {
+
+namespace {
+
+const uint64_t SHARED_MAGIC = 0x66617374746578ull;
+const int64_t PAGE_SIZE = 4096;
+const int32_t POLL_MILLISECONDS = 100;
+
+int64_t alignUp(int64_t offset, int64_t alignment) {
+  return (offset + alignment - 1) / alignment * alignment;
+}
+
+bool processAlive(int64_t pid) {
+  return pid != 0 && (kill(pid_t(pid), 0) == 0 || errno == EPERM);
+}
+
+void pause() {
+  std::this_thread::sleep_for(std::chrono::milliseconds(POLL_MILLISECONDS));
+}
+
+} // namespace
+
+struct SharedModel::Header {
+  // set last by the creator, once the rest of the header is written
+  std::atomic<uint64_t> magic;
+  int64_t creator;
+  int64_t inputRows;
+  int64_t outputRows;
+  int64_t dim;
+  int64_t tableBytes;
+  int32_t padded;
+  int32_t workers;
+  std::atomic<int32_t> ready;
+  std::atomic<int32_t> attached;
+  std::atomic<int32_t> stop;
+  std::atomic<int64_t> tokenCount;
+  std::atomic<int64_t> tokenBudget;
+};
+
+// Layout: the header, one pid per rank, then the input and output
+// matrices each on their own pages, then the table.
+SharedModel::SharedModel(
+    std::shared_ptr<const Args> args,
+    int64_t inputRows,
+    int64_t outputRows,
+    int64_t tableBytes)
+    : args_(args),
+      header_(nullptr),
+      pids_(nullptr),
+      inputRows_(inputRows),
+      outputRows_(outputRows) {
+  const int64_t stride =
+      args_->padRows ? DenseMatrix::paddedStride(args_->dim) : args_->dim;
+  const int64_t pidsOffset = alignUp(sizeof(Header), sizeof(int64_t));
+  inputOffset_ =
+      alignUp(pidsOffset + args_->workers * sizeof(int64_t), PAGE_SIZE);
+  outputOffset_ = alignUp(
+      inputOffset_ + inputRows * stride * int64_t(sizeof(real)), PAGE_SIZE);
+  tableOffset_ = alignUp(
+      outputOffset_ + outputRows * stride * int64_t(sizeof(real)),
+      DenseMatrix::ROW_ALIGNMENT);
+  const int64_t size = tableOffset_ + tableBytes;
+
+  if (args_->rank == 0) {
+    segment_ = std::make_shared<utils::SharedMemory>(args_->shm, size, true);
+    header_ = new (segment_->data()) Header();
+    header_->creator = getpid();
+    header_->inputRows = inputRows;
+    header_->outputRows = outputRows;
+    header_->dim = args_->dim;
+    header_->tableBytes = tableBytes;
+    header_->padded = args_->padRows;
+    header_->workers = args_->workers;
+    header_->magic.store(SHARED_MAGIC, std::memory_order_release);
+    if (args_->numa == numa_policy::interleave) {
+      utils::numaInterleave(
+          segment_->data() + inputOffset_, tableOffset_ - inputOffset_);
+    }
+  } else {
+    // rank 0 may still be building its dictionary, or a segment left by a
+    // run that died may still be there until rank 0 replaces it
+    bool waiting = false;
+    while (true) {
+      try {
+        segment_ =
+            std::make_shared<utils::SharedMemory>(args_->shm, 0, false);
+      } catch (const std::runtime_error&) {
+        segment_ = nullptr;
+      }
+      if (segment_ && segment_->size() >= int64_t(sizeof(Header))) {
+        header_ = reinterpret_cast<Header*>(segment_->data());
+        if (header_->magic.load(std::memory_order_acquire) == SHARED_MAGIC &&
+            processAlive(header_->creator)) {
+          break;
+        }
+      }
+      if (!waiting && args_->verbose > 1) {
+        std::cerr << "Waiting for rank 0 to create " << args_->shm
+                  << std::endl;
+        waiting = true;
+      }
+      pause();
+    }
+    if (header_->inputRows != inputRows || header_->outputRows != outputRows ||
+        header_->dim != args_->dim || header_->tableBytes != tableBytes ||
+        header_->padded != int32_t(args_->padRows) ||
+        header_->workers != args_->workers || segment_->size() < size) {
+      throw std::invalid_argument(
+          "Shared memory " + args_->shm +
+          " holds a model of another shape: are -input, -dim and -workers the"
+          " same for every worker?");
+    }
+  }
+  pids_ = reinterpret_cast<std::atomic<int64_t>*>(
+      segment_->data() + pidsOffset);
+}
+
+std::shared_ptr<DenseMatrix> SharedModel::input() const {
+  return std::make_shared<DenseMatrix>(
+      inputRows_, args_->dim, segment_, inputOffset_, args_->padRows);
+}
+
+std::shared_ptr<DenseMatrix> SharedModel::output() const {
+  return std::make_shared<DenseMatrix>(
+      outputRows_, args_->dim, segment_, outputOffset_, args_->padRows);
+}
+
+char* SharedModel::table() const {
+  return segment_->data() + tableOffset_;
+}
+
+int64_t SharedModel::start(int64_t tokenBudget) {
+  const int32_t rank = args_->rank;
+  if (rank == 0) {
+    header_->tokenBudget = tokenBudget;
+    header_->ready.store(1, std::memory_order_release);
+  } else {
+    while (!header_->ready.load(std::memory_order_acquire)) {
+      if (!processAlive(header_->creator)) {
+        throw std::runtime_error("Rank 0 exited before training started");
+      }
+      pause();
+    }
+  }
+  if (alive(rank)) {
+    throw std::invalid_argument(
+        "Rank " + std::to_string(rank) + " is already training on " +
+        args_->shm);
+  }
+  pids_[rank] = getpid();
+  header_->attached++;
+  while (header_->attached.load() < args_->workers) {
+    if (header_->stop) {
+      throw std::runtime_error("Another worker stopped training");
+    }
+    pause();
+  }
+  // everybody has it mapped now, and it goes away with the last of them
+  if (rank == 0) {
+    segment_->unlink();
+  }
+  return header_->tokenBudget;
+}
+
+std::atomic<int64_t>& SharedModel::tokenCount() {
+  return header_->tokenCount;
+}
+
+bool SharedModel::stopped() const {
+  return header_->stop.load(std::memory_order_relaxed) != 0;
+}
+
+void SharedModel::stop() {
+  header_->stop = 1;
+}
+
+bool SharedModel::alive(int32_t rank) const {
+  return processAlive(pids_[rank].load());
+}
+
+void SharedModel::finish() {
+  pids_[args_->rank] = 0;
+  for (int32_t rank = 0; rank < args_->workers; rank++) {
+    while (alive(rank)) {
+      pause();
+    }
+  }
+}
+
+} // namespace fasttext
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "args.h"
+#include "densematrix.h"
+#include "utils.h"
+
+namespace fasttext {
+
+// Parameters of the processes training together with -shm: a named POSIX
+// shared memory segment with a header, the input and output matrices and
+// the negative sampling table. Rank 0 creates and initializes it, the
+// other ranks attach to it, and the threads of every process then update
+// the same rows, Hogwild across processes. The token count (and so the
+// learning rate) and stopping go through atomics in the header.
+class SharedModel {
+ public:
+  // Rank 0 creates the segment, the others wait for it to appear and check
+  // that it has the same shape.
+  SharedModel(
+      std::shared_ptr<const Args> args,
+      int64_t inputRows,
+      int64_t outputRows,
+      int64_t tableBytes);
+  SharedModel(const SharedModel&) = delete;
+  SharedModel& operator=(const SharedModel&) = delete;
+
+  std::shared_ptr<DenseMatrix> input() const;
+  std::shared_ptr<DenseMatrix> output() const;
+  char* table() const;
+
+  // Called by rank 0 once the parameters are initialized, and by the
+  // others before reading them: waits until every worker has attached and
+  // returns the token budget set by rank 0.
+  int64_t start(int64_t tokenBudget);
+  std::atomic<int64_t>& tokenCount();
+  bool stopped() const;
+  void stop();
+  // Marks this process as done and waits for the others to be done too,
+  // or to have exited.
+  void finish();
+
+ private:
+  struct Header;
+
+  bool alive(int32_t rank) const;
+
+  std::shared_ptr<const Args> args_;
+  std::shared_ptr<utils::SharedMemory> segment_;
+  Header* header_;
+  // pid of each rank while it trains, 0 before and after
+  std::atomic<int64_t>* pids_;
+  int64_t inputRows_;
+  int64_t outputRows_;
+  int64_t inputOffset_;
+  int64_t outputOffset_;
+  int64_t tableOffset_;
+};
+
+} // namespace fasttext
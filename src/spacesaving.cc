@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "spacesaving.h"
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace fasttext {
+
+SpaceSaving::SpaceSaving(int64_t capacity) : capacity_(capacity), total_(0) {
+  // slots are indexed with int32_t
+  if (capacity < 1 || capacity > std::numeric_limits<int32_t>::max()) {
+    throw std::invalid_argument(
+        "SpaceSaving capacity must be between 1 and " +
+        std::to_string(std::numeric_limits<int32_t>::max()));
+  }
+  counters_.reserve(capacity);
+  heap_.reserve(capacity);
+  pos_.reserve(capacity);
+  index_.reserve(capacity);
+}
+
+void SpaceSaving::add(const std::string& word) {
+  total_++;
+  auto it = index_.find(word);
+  if (it != index_.end()) {
+    counters_[it->second].count++;
+    siftDown(pos_[it->second]);
+    return;
+  }
+  if (int64_t(counters_.size()) < capacity_) {
+    int32_t slot = counters_.size();
+    counters_.push_back(Counter{word, 1, 0, total_});
+    index_.emplace(word, slot);
+    // a new counter of 1 is never above its parent
+    pos_.push_back(heap_.size());
+    heap_.push_back(slot);
+    for (int32_t i = pos_[slot]; i > 0;) {
+      int32_t parent = (i - 1) / 2;
+      if (counters_[heap_[parent]].count <= counters_[heap_[i]].count) {
+        break;
+      }
+      std::swap(heap_[parent], heap_[i]);
+      pos_[heap_[parent]] = parent;
+      pos_[heap_[i]] = i;
+      i = parent;
+    }
+    return;
+  }
+  // replace the smallest counter; the newcomer inherits its count as error
+  int32_t slot = heap_[0];
+  Counter& c = counters_[slot];
+  index_.erase(c.word);
+  c.word = word;
+  c.error = c.count;
+  c.count++;
+  c.first = total_;
+  index_.emplace(word, slot);
+  siftDown(0);
+}
+
+void SpaceSaving::siftDown(int32_t i) {
+  int32_t n = heap_.size();
+  while (true) {
+    int32_t smallest = i;
+    int32_t left = 2 * i + 1, right = 2 * i + 2;
+    if (left < n &&
+        counters_[heap_[left]].count < counters_[heap_[smallest]].count) {
+      smallest = left;
+    }
+    if (right < n &&
+        counters_[heap_[right]].count < counters_[heap_[smallest]].count) {
+      smallest = right;
+    }
+    if (smallest == i) {
+      return;
+    }
+    std::swap(heap_[i], heap_[smallest]);
+    pos_[heap_[i]] = i;
+    pos_[heap_[smallest]] = smallest;
+    i = smallest;
+  }
+}
+
+int64_t SpaceSaving::size() const {
+  return counters_.size();
+}
+
+int64_t SpaceSaving::total() const {
+  return total_;
+}
+
+int64_t SpaceSaving::minCount() const {
+  if (int64_t(counters_.size()) < capacity_) {
+    return 0;
+  }
+  return counters_[heap_[0]].count;
+}
+
+const std::vector<SpaceSaving::Counter>& SpaceSaving::counters() const {
+  return counters_;
+}
+
+} // namespace fasttext
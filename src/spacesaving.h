@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fasttext {
+
+// Space-Saving heavy-hitter counter (Metwally et al.) holding at most
+// `capacity` words. Every tracked word's count overestimates its true
+// count by at most its `error`, and any word that is not tracked occurred
+// at most minCount() times.
+class SpaceSaving {
+ public:
+  struct Counter {
+    std::string word;
+    int64_t count;
+    int64_t error;
+    int64_t first;
+  };
+
+  explicit SpaceSaving(int64_t capacity);
+
+  void add(const std::string& word);
+  int64_t size() const;
+  int64_t total() const;
+  int64_t minCount() const;
+  const std::vector<Counter>& counters() const;
+
+ private:
+  int64_t capacity_;
+  int64_t total_;
+  std::vector<Counter> counters_;
+  std::unordered_map<std::string, int32_t> index_;
+  // min-heap of counter slots by count, and each slot's heap position
+  std::vector<int32_t> heap_;
+  std::vector<int32_t> pos_;
+
+  void siftDown(int32_t i);
+};
+
+} // namespace fasttext
@@ -0,0 +1,163 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "streamreader.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace fasttext {
+
+struct StreamReader::Queue {
+  explicit Queue(size_t capacity)
+      : capacity(capacity), done(false), stopped(false), reading(false) {}
+
+  // Waits for room; drops the block once the reader is stopped.
+  void push(std::string block) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(
+        lock, [this]() { return blocks.size() < capacity || stopped; });
+    if (!stopped) {
+      blocks.push_back(std::move(block));
+    }
+    lock.unlock();
+    notEmpty.notify_one();
+  }
+
+  const size_t capacity;
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::deque<std::string> blocks;
+  bool done;
+  bool stopped;
+  // the thread is in a read of the stream, which may never return
+  bool reading;
+};
+
+StreamReader::StreamReader(
+    std::istream& in,
+    std::string prefix,
+    int32_t capacity)
+    : queue_(std::make_shared<Queue>(std::max(1, capacity))) {
+  thread_ = std::thread(run, queue_, std::ref(in), std::move(prefix));
+}
+
+// A thread that is not reading is waiting for room, or about to check
+// `stopped`, and exits at once.
+StreamReader::~StreamReader() {
+  stop();
+  bool reading;
+  {
+    std::lock_guard<std::mutex> lock(queue_->mutex);
+    reading = queue_->reading;
+  }
+  if (reading) {
+    thread_.detach();
+  } else {
+    thread_.join();
+  }
+}
+
+void StreamReader::stop() {
+  {
+    std::lock_guard<std::mutex> lock(queue_->mutex);
+    queue_->stopped = true;
+  }
+  queue_->notFull.notify_all();
+  queue_->notEmpty.notify_all();
+}
+
+bool StreamReader::next(std::string& block) {
+  std::unique_lock<std::mutex> lock(queue_->mutex);
+  queue_->notEmpty.wait(lock, [this]() {
+    return !queue_->blocks.empty() || queue_->done || queue_->stopped;
+  });
+  if (queue_->blocks.empty() || queue_->stopped) {
+    return false;
+  }
+  block = std::move(queue_->blocks.front());
+  queue_->blocks.pop_front();
+  lock.unlock();
+  queue_->notFull.notify_one();
+  return true;
+}
+
+bool StreamReader::exhausted() const {
+  std::lock_guard<std::mutex> lock(queue_->mutex);
+  return queue_->done && queue_->blocks.empty();
+}
+
+// Blocks are cut after the last newline read; the rest starts the next
+// block, so no line is split between two threads.
+void StreamReader::run(
+    std::shared_ptr<Queue> queue,
+    std::istream& in,
+    std::string prefix) {
+  std::string carry, block;
+  size_t begin = 0;
+  while (begin < prefix.size()) {
+    size_t end = prefix.rfind('\n', begin + BLOCK_SIZE - 1);
+    if (end == std::string::npos || end < begin) {
+      end = prefix.find('\n', begin);
+    }
+    if (end == std::string::npos) {
+      carry = prefix.substr(begin);
+      break;
+    }
+    queue->push(prefix.substr(begin, end + 1 - begin));
+    begin = end + 1;
+  }
+  prefix = std::string();
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      if (queue->stopped) {
+        break;
+      }
+      queue->reading = true;
+    }
+    block.swap(carry);
+    carry.clear();
+    size_t size = block.size();
+    block.resize(size + BLOCK_SIZE);
+    in.read(&block[size], BLOCK_SIZE);
+    block.resize(size + in.gcount());
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->reading = false;
+    }
+    if (!in) {
+      if (!block.empty()) {
+        queue->push(std::move(block));
+      }
+      break;
+    }
+    size_t end = block.rfind('\n');
+    if (end == std::string::npos) {
+      // a line longer than a block: keep reading
+      carry.swap(block);
+      continue;
+    }
+    carry.assign(block, end + 1, std::string::npos);
+    block.resize(end + 1);
+    queue->push(std::move(block));
+    block = std::string();
+  }
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->done = true;
+  }
+  queue->notEmpty.notify_all();
+}
+
+} // namespace fasttext
@@ -0,0 +1,55 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace fasttext {
+
+// Reads a stream that cannot be seeked or read twice (stdin, a pipe) on a
+// background thread and hands it out in blocks of whole lines, so that
+// the training threads can share it. `prefix`, text already consumed from
+// the stream, is handed out first. At most `capacity` blocks are buffered.
+// Destroying the reader does not wait for a read blocked on a pipe that
+// has nothing more to say: the thread is left to finish that read and exit
+// on its own, holding only the stream and the queue it shares.
+class StreamReader {
+ public:
+  static const int64_t BLOCK_SIZE = 1 << 20;
+
+  StreamReader(std::istream& in, std::string prefix, int32_t capacity);
+  StreamReader(const StreamReader&) = delete;
+  StreamReader& operator=(const StreamReader&) = delete;
+  ~StreamReader();
+
+  // Moves the next block into `block`; false once the stream is exhausted
+  // or the reader is stopped.
+  bool next(std::string& block);
+  bool exhausted() const;
+  // Wakes the threads waiting in next(), which then return false, without
+  // waiting for the stream.
+  void stop();
+
+ private:
+  struct Queue;
+
+  static void run(
+      std::shared_ptr<Queue> queue,
+      std::istream& in,
+      std::string prefix);
+
+  std::shared_ptr<Queue> queue_;
+  std::thread thread_;
+};
+
+} // namespace fasttext
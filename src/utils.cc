@@ -8,8 +8,25 @@
 
 #include "utils.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <iomanip>
 #include <ios>
+#include <new>
+#include <stdexcept>
 
 namespace fasttext {
 
@@ -25,6 +42,134 @@ void seek(std::ifstream& ifs, int64_t pos) {
   ifs.seekg(std::streampos(pos));
 }
 
+int64_t stdinSize() {
+  struct stat st;
+  if (fstat(STDIN_FILENO, &st) != 0 || !S_ISREG(st.st_mode)) {
+    return -1;
+  }
+  return st.st_size;
+}
+
+namespace {
+
+// powers of ten that are exact in double precision
+const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                         1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                         1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+const int kMaxPow10 = 22;
+
+int formatFallback(char* buf, float x, int precision) {
+  return snprintf(buf, 32, "%.*g", precision, double(x));
+}
+
+} // namespace
+
+int formatFloat(char* buf, float x, int precision) {
+  if (precision < 1 || precision > 9 || !std::isfinite(x)) {
+    return formatFallback(buf, x, precision);
+  }
+  char* p = buf;
+  if (std::signbit(x)) {
+    *p++ = '-';
+  }
+  double a = std::fabs(double(x));
+  if (a == 0.0) {
+    *p++ = '0';
+    return p - buf;
+  }
+  // floor(log10(2^(e2 - 1))), corrected below when a rounds the other way
+  int e2;
+  std::frexp(a, &e2);
+  int e = ((e2 - 1) * 78913) >> 18;
+  int k = precision - 1 - e;
+  if (k > kMaxPow10 || -k > kMaxPow10) {
+    return formatFallback(buf, x, precision);
+  }
+  // a has 24 significant bits, so scaling by an exact power of ten
+  // rounds once and stays within 1e-9 of the true value at this size
+  double scaled = k >= 0 ? a * kPow10[k] : a / kPow10[-k];
+  if (scaled < kPow10[precision - 1]) {
+    e--;
+    k++;
+    if (k > kMaxPow10) {
+      return formatFallback(buf, x, precision);
+    }
+    scaled = k >= 0 ? a * kPow10[k] : a / kPow10[-k];
+  } else if (scaled >= kPow10[precision]) {
+    e++;
+    k--;
+    if (-k > kMaxPow10) {
+      return formatFallback(buf, x, precision);
+    }
+    scaled = k >= 0 ? a * kPow10[k] : a / kPow10[-k];
+  }
+  double fraction = scaled - std::floor(scaled);
+  if (std::fabs(fraction - 0.5) < 1e-6) {
+    return formatFallback(buf, x, precision);
+  }
+  uint64_t digits = uint64_t(std::floor(scaled)) + (fraction > 0.5 ? 1 : 0);
+  if (digits >= uint64_t(kPow10[precision])) {
+    digits /= 10;
+    e++;
+  }
+
+  char d[16];
+  for (int i = precision - 1; i >= 0; i--) {
+    d[i] = char('0' + digits % 10);
+    digits /= 10;
+  }
+  int nd = precision;
+  if (e < -4 || e >= precision) {
+    while (nd > 1 && d[nd - 1] == '0') {
+      nd--;
+    }
+    *p++ = d[0];
+    if (nd > 1) {
+      *p++ = '.';
+      for (int i = 1; i < nd; i++) {
+        *p++ = d[i];
+      }
+    }
+    *p++ = 'e';
+    *p++ = e < 0 ? '-' : '+';
+    int ae = e < 0 ? -e : e;
+    if (ae >= 100) {
+      *p++ = char('0' + ae / 100);
+    }
+    *p++ = char('0' + (ae / 10) % 10);
+    *p++ = char('0' + ae % 10);
+    return p - buf;
+  }
+  if (e >= 0) {
+    int ni = e + 1;
+    while (nd > ni && d[nd - 1] == '0') {
+      nd--;
+    }
+    for (int i = 0; i < ni; i++) {
+      *p++ = d[i];
+    }
+    if (nd > ni) {
+      *p++ = '.';
+      for (int i = ni; i < nd; i++) {
+        *p++ = d[i];
+      }
+    }
+    return p - buf;
+  }
+  while (nd > 1 && d[nd - 1] == '0') {
+    nd--;
+  }
+  *p++ = '0';
+  *p++ = '.';
+  for (int i = 0; i < -e - 1; i++) {
+    *p++ = '0';
+  }
+  for (int i = 0; i < nd; i++) {
+    *p++ = d[i];
+  }
+  return p - buf;
+}
+
 double getDuration(
     const std::chrono::steady_clock::time_point& start,
     const std::chrono::steady_clock::time_point& end) {
@@ -32,6 +177,286 @@ double getDuration(
       .count();
 }
 
+MappedFile::MappedFile(const std::string& path)
+    : data_(nullptr), size_(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument(path + " cannot be opened for mapping!");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::invalid_argument(path + " cannot be opened for mapping!");
+  }
+  size_ = st.st_size;
+  if (size_ > 0) {
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error(path + " cannot be mapped!");
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+AnonymousMemory::AnonymousMemory(int64_t size) : data_(nullptr), size_(size) {
+  if (size_ > 0) {
+    void* addr = mmap(
+        nullptr,
+        size_,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+    if (addr == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    data_ = static_cast<char*>(addr);
+  }
+}
+
+AnonymousMemory::~AnonymousMemory() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+SharedMemory::SharedMemory(const std::string& name, int64_t size, bool create)
+    : name_(name), data_(nullptr), size_(size) {
+  if (name_.empty() || name_[0] != '/') {
+    name_ = "/" + name_;
+  }
+  int fd;
+  if (create) {
+    shm_unlink(name_.c_str());
+    fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0 && ftruncate(fd, size_) != 0) {
+      close(fd);
+      shm_unlink(name_.c_str());
+      throw std::runtime_error("Shared memory " + name_ + " cannot be sized!");
+    }
+  } else {
+    fd = shm_open(name_.c_str(), O_RDWR, 0);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+      size_ = st.st_size;
+    }
+  }
+  if (fd < 0) {
+    throw std::runtime_error("Shared memory " + name_ + " cannot be opened!");
+  }
+  if (size_ > 0) {
+    void* addr =
+        mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Shared memory " + name_ + " cannot be mapped!");
+    }
+    data_ = static_cast<char*>(addr);
+  }
+  close(fd);
+}
+
+SharedMemory::~SharedMemory() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+void SharedMemory::unlink() {
+  shm_unlink(name_.c_str());
+}
+
+namespace {
+
+// Parses the kernel's cpu/node list format, e.g. "0-3,8,10-11".
+std::vector<int32_t> readList(const std::string& path) {
+  std::vector<int32_t> result;
+  std::ifstream ifs(path);
+  std::string list;
+  if (!std::getline(ifs, list)) {
+    return result;
+  }
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string range = list.substr(pos, end - pos);
+    size_t dash = range.find('-');
+    try {
+      int32_t first = std::stoi(range.substr(0, dash));
+      int32_t last =
+          dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+      for (int32_t i = first; i <= last; i++) {
+        result.push_back(i);
+      }
+    } catch (const std::exception&) {
+    }
+    pos = end + 1;
+  }
+  return result;
+}
+
+#ifdef __linux__
+const int MPOL_BIND_MODE = 2;
+const int MPOL_INTERLEAVE_MODE = 3;
+const int32_t MAX_NODES = 1024;
+const int64_t BITS_PER_WORD = 8 * sizeof(unsigned long);
+
+bool setPolicy(void* addr, int64_t size, int mode, const std::vector<int32_t>& nodes) {
+  if (nodes.empty() || size <= 0) {
+    return false;
+  }
+  std::vector<unsigned long> mask(MAX_NODES / BITS_PER_WORD, 0);
+  for (int32_t node : nodes) {
+    if (node >= 0 && node < MAX_NODES) {
+      mask[node / BITS_PER_WORD] |= 1UL << (node % BITS_PER_WORD);
+    }
+  }
+  // mbind wants a page aligned start; round outwards to whole pages
+  const uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(page - 1);
+  uintptr_t end = reinterpret_cast<uintptr_t>(addr) + size;
+  return syscall(
+             SYS_mbind,
+             begin,
+             end - begin,
+             mode,
+             mask.data(),
+             MAX_NODES + 1,
+             0) == 0;
+}
+#endif
+
+} // namespace
+
+bool numaInterleave(void* addr, int64_t size) {
+#ifdef __linux__
+  std::vector<int32_t> nodes = readList("/sys/devices/system/node/online");
+  return nodes.size() > 1 && setPolicy(addr, size, MPOL_INTERLEAVE_MODE, nodes);
+#else
+  return false;
+#endif
+}
+
+bool numaBind(void* addr, int64_t size, int32_t node) {
+#ifdef __linux__
+  return node >= 0 &&
+      setPolicy(addr, size, MPOL_BIND_MODE, std::vector<int32_t>(1, node));
+#else
+  return false;
+#endif
+}
+
+int32_t currentNumaNode() {
+#ifdef __linux__
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return int32_t(node);
+  }
+#endif
+  return -1;
+}
+
+bool pinThread(int32_t cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  return false;
+#endif
+}
+
+std::vector<int32_t> cpuOrder(bool scatter) {
+  std::vector<int32_t> order;
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return order;
+  }
+  std::vector<std::vector<int32_t>> nodes;
+  for (int32_t node : readList("/sys/devices/system/node/online")) {
+    std::vector<int32_t> cpus;
+    for (int32_t cpu : readList(
+             "/sys/devices/system/node/node" + std::to_string(node) +
+             "/cpulist")) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+    if (!cpus.empty()) {
+      nodes.push_back(cpus);
+    }
+  }
+  if (nodes.empty()) {
+    nodes.resize(1);
+    for (int32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        nodes[0].push_back(cpu);
+      }
+    }
+  }
+  if (!scatter) {
+    for (const auto& cpus : nodes) {
+      order.insert(order.end(), cpus.begin(), cpus.end());
+    }
+    return order;
+  }
+  for (size_t i = 0;; i++) {
+    size_t added = 0;
+    for (const auto& cpus : nodes) {
+      if (i < cpus.size()) {
+        order.push_back(cpus[i]);
+        added++;
+      }
+    }
+    if (added == 0) {
+      break;
+    }
+  }
+#endif
+  return order;
+}
+
+int64_t forkCall(const std::function<bool()>& fn) {
+  pid_t pid = fork();
+  if (pid != 0) {
+    return pid;
+  }
+  // only this thread exists in the child: skip destructors and atexit
+  // handlers, which could wait on the parent's other threads
+  bool ok = false;
+  try {
+    ok = fn();
+  } catch (...) {
+  }
+  _exit(ok ? 0 : 1);
+}
+
+int32_t reapChild(int64_t pid, bool block) {
+  int status = 0;
+  pid_t ret;
+  do {
+    ret = waitpid(pid_t(pid), &status, block ? 0 : WNOHANG);
+  } while (ret < 0 && errno == EINTR);
+  if (ret == 0) {
+    return 0;
+  }
+  return ret > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 1 : -1;
+}
+
 ClockPrint::ClockPrint(int32_t duration) : duration_(duration) {}
 
 std::ostream& operator<<(std::ostream& out, const ClockPrint& me) {
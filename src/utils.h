@@ -13,7 +13,10 @@
 #include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <functional>
 #include <ostream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #if defined(__clang__) || defined(__GNUC__)
@@ -34,16 +37,154 @@ int64_t size(std::ifstream&);
 
 void seek(std::ifstream&, int64_t);
 
+// Size of stdin when it is redirected from a regular file, -1 otherwise.
+int64_t stdinSize();
+
 template <typename T>
 bool contains(const std::vector<T>& container, const T& value) {
   return std::find(container.begin(), container.end(), value) !=
       container.end();
 }
 
+// Sorts with nthreads threads: chunks are sorted concurrently and then
+// merged pairwise. Matches std::sort exactly when comp is a total order.
+template <typename T, typename Compare>
+void parallelSort(std::vector<T>& v, Compare comp, int32_t nthreads) {
+  const size_t n = v.size();
+  if (nthreads <= 1 || n < size_t(nthreads) * 1024) {
+    std::sort(v.begin(), v.end(), comp);
+    return;
+  }
+  std::vector<size_t> bounds(nthreads + 1);
+  for (int32_t i = 0; i <= nthreads; i++) {
+    bounds[i] = i * n / nthreads;
+  }
+  std::vector<std::thread> threads;
+  for (int32_t i = 0; i < nthreads; i++) {
+    threads.push_back(std::thread([&, i]() {
+      std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1], comp);
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (int32_t width = 1; width < nthreads; width *= 2) {
+    threads.clear();
+    for (int32_t i = 0; i + width < nthreads; i += 2 * width) {
+      int32_t last = std::min(i + 2 * width, nthreads);
+      threads.push_back(std::thread([&, i, width, last]() {
+        std::inplace_merge(
+            v.begin() + bounds[i],
+            v.begin() + bounds[i + width],
+            v.begin() + bounds[last],
+            comp);
+      }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+}
+
+// Formats x exactly as printf("%.*g", precision, double(x)) (and hence
+// an ostream with setprecision(precision)) would, without the locale and
+// stream machinery. Returns the number of characters written; buf must
+// hold at least 32 bytes. Values close to a rounding tie fall back to
+// snprintf so the result is always identical.
+int formatFloat(char* buf, float x, int precision);
+
 double getDuration(
     const std::chrono::steady_clock::time_point& start,
     const std::chrono::steady_clock::time_point& end);
 
+// Read-only memory map of a whole file.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  inline const char* data() const {
+    return data_;
+  }
+  inline int64_t size() const {
+    return size_;
+  }
+
+ private:
+  const char* data_;
+  int64_t size_;
+};
+
+// Private anonymous memory of `size` bytes. Pages are only allocated when
+// first written, so they land on the NUMA node of the thread that writes
+// them unless a policy is set with numaInterleave or numaBind.
+class AnonymousMemory {
+ public:
+  explicit AnonymousMemory(int64_t size);
+  AnonymousMemory(const AnonymousMemory&) = delete;
+  AnonymousMemory& operator=(const AnonymousMemory&) = delete;
+  ~AnonymousMemory();
+
+  inline char* data() const {
+    return data_;
+  }
+  inline int64_t size() const {
+    return size_;
+  }
+
+ private:
+  char* data_;
+  int64_t size_;
+};
+
+// Named POSIX shared memory (shm_open), mapped read-write. `create` makes
+// a new zero-filled segment of `size` bytes, replacing a stale one of the
+// same name; otherwise an existing segment is opened whole. The memory
+// stays valid in every process that maps it after the name is unlinked.
+class SharedMemory {
+ public:
+  SharedMemory(const std::string& name, int64_t size, bool create);
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+  ~SharedMemory();
+
+  inline char* data() const {
+    return data_;
+  }
+  inline int64_t size() const {
+    return size_;
+  }
+  void unlink();
+
+ private:
+  std::string name_;
+  char* data_;
+  int64_t size_;
+};
+
+// NUMA placement and CPU affinity. These call the Linux syscalls directly;
+// elsewhere, or when the kernel refuses, they do nothing and return false.
+// The page policies only affect pages that have not been touched yet.
+bool numaInterleave(void* addr, int64_t size);
+bool numaBind(void* addr, int64_t size, int32_t node);
+int32_t currentNumaNode();
+bool pinThread(int32_t cpu);
+
+// CPUs this process may run on, node by node (compact) or taking one CPU
+// from each node in turn (scatter).
+std::vector<int32_t> cpuOrder(bool scatter);
+
+// Runs fn in a forked child, which works on a copy-on-write snapshot of
+// this process while the parent carries on, and returns the child's pid
+// (-1 if fork failed). The child exits with status 0 iff fn returns true.
+int64_t forkCall(const std::function<bool()>& fn);
+
+// Reaps a child started by forkCall: 1 if it succeeded, -1 if it failed
+// and 0 if it is still running (only when block is false).
+int32_t reapChild(int64_t pid, bool block);
+
 class ClockPrint {
  public:
   explicit ClockPrint(int32_t duration);
@@ -13,6 +13,7 @@
 #include <cmath>
 #include <iomanip>
 
+#include "kernels.h"
 #include "matrix.h"
 
 namespace fasttext {
@@ -24,31 +25,21 @@ namespace fasttext {
     }
 
     real Vector::norm() const {
-        real sum = 0;
-        for (int64_t i = 0; i < size(); i++) {
-            sum += data_[i] * data_[i];
-        }
-        return std::sqrt(sum);
+        return std::sqrt(kernels::get().sqnorm(data_.data(), size()));
     }
 
     void Vector::mul(real a) {
-        for (int64_t i = 0; i < size(); i++) {
-            data_[i] *= a;
-        }
+        kernels::get().scale(a, data_.data(), size());
     }
 
     void Vector::addVector(const Vector& source) {
         assert(size() == source.size());
-        for (int64_t i = 0; i < size(); i++) {
-            data_[i] += source.data_[i];
-        }
+        kernels::get().axpy(1.0, source.data_.data(), data_.data(), size());
     }
 
     void Vector::addVector(const Vector& source, real s) {
         assert(size() == source.size());
-        for (int64_t i = 0; i < size(); i++) {
-            data_[i] += s * source.data_[i];
-        }
+        kernels::get().axpy(s, source.data_.data(), data_.data(), size());
     }
 
     void Vector::addRow(const Matrix& A, int64_t i, real a) {
@@ -74,13 +65,9 @@ namespace fasttext {
         }
     }
 
-    double Vector::dotMul(Vector &vec, double a) {
+    real Vector::dotMul(const Vector& vec, real a) const {
         assert(vec.size() == size());
-        double result = 0;
-        for (int64_t i = 0; i < size(); i++) {
-            result += data_[i] * vec.data_[i] * a;
-        }
-        return result;
+        return a * kernels::get().dot(data_.data(), vec.data_.data(), size());
     }
 
     int64_t Vector::argmax() {
@@ -53,7 +53,7 @@ namespace fasttext {
         void addRow(const Matrix&, int64_t);
         void addRow(const Matrix&, int64_t, real);
         void mul(const Matrix&, const Vector&);
-        double dotMul(Vector & vec, double a); // inner product between Vectors
+        real dotMul(const Vector& vec, real a) const; // inner product between Vectors
         int64_t argmax();
     };
 